@@ -0,0 +1,1002 @@
+// SPDX-FileCopyrightText: (c) 2026 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include <lzma.h>
+#include "bzlib_wrapper.hpp"
+
+module pragma.filesystem;
+
+import :archive;
+import :glob;
+import :util;
+
+static constexpr unsigned char to_lower_path_char(unsigned char c)
+{
+	if(c == '\\')
+		return '/';
+	return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + ('a' - 'A')) : c;
+}
+static bool paths_equal(const std::string_view &a, const std::string_view &b)
+{
+	if(a.length() != b.length())
+		return false;
+	for(size_t i = 0; i < a.length(); ++i) {
+		if(to_lower_path_char(static_cast<unsigned char>(a[i])) != to_lower_path_char(static_cast<unsigned char>(b[i])))
+			return false;
+	}
+	return true;
+}
+// Removes leading and trailing separators and converts the remaining ones to '/'
+static std::string normalize_archive_path(std::string_view path)
+{
+	while(!path.empty() && (path.front() == '/' || path.front() == '\\'))
+		path.remove_prefix(1);
+	while(!path.empty() && (path.back() == '/' || path.back() == '\\'))
+		path.remove_suffix(1);
+	std::string result {path};
+	std::replace(result.begin(), result.end(), '\\', '/');
+	return result;
+}
+
+uint64_t pragma::filesystem::archive::hash_path(const std::string_view &path)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for(auto c : path) {
+		hash ^= to_lower_path_char(static_cast<unsigned char>(c));
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+uint32_t pragma::filesystem::archive::crc32(std::span<const uint8_t> data, uint32_t crc) { return lzma_crc32(data.data(), data.size(), crc); }
+
+std::optional<std::vector<uint8_t>> pragma::filesystem::archive::compress(ArchiveCompression compression, std::span<const uint8_t> data, uint32_t level)
+{
+	switch(compression) {
+	case ArchiveCompression::None:
+		return std::vector<uint8_t>(data.begin(), data.end());
+	case ArchiveCompression::Lzma:
+		{
+			std::vector<uint8_t> out(lzma_stream_buffer_bound(data.size()));
+			size_t outPos = 0;
+			if(lzma_easy_buffer_encode(std::min<uint32_t>(level, 9), LZMA_CHECK_NONE, nullptr, data.data(), data.size(), out.data(), &outPos, out.size()) != LZMA_OK)
+				return {};
+			out.resize(outPos);
+			return out;
+		}
+	case ArchiveCompression::Bz2:
+		{
+			// Worst case size according to the bzip2 documentation
+			auto bound = data.size() + data.size() / 100 + 600;
+			if(bound > std::numeric_limits<unsigned int>::max())
+				return {};
+			std::vector<uint8_t> out(bound);
+			auto outSize = static_cast<unsigned int>(out.size());
+			auto blockSize = static_cast<int>(std::clamp<uint32_t>(level, 1, 9));
+			if(BZ2_bzBuffToBuffCompress(reinterpret_cast<char *>(out.data()), &outSize, const_cast<char *>(reinterpret_cast<const char *>(data.data())), static_cast<unsigned int>(data.size()), blockSize, 0, 0) != BZ_OK)
+				return {};
+			out.resize(outSize);
+			return out;
+		}
+	}
+	return {};
+}
+
+bool pragma::filesystem::archive::decompress(ArchiveCompression compression, std::span<const uint8_t> data, std::span<uint8_t> out)
+{
+	switch(compression) {
+	case ArchiveCompression::None:
+		if(data.size() != out.size())
+			return false;
+		if(!data.empty())
+			std::memcpy(out.data(), data.data(), data.size());
+		return true;
+	case ArchiveCompression::Lzma:
+		{
+			uint64_t memLimit = std::numeric_limits<uint64_t>::max();
+			size_t inPos = 0;
+			size_t outPos = 0;
+			auto res = lzma_stream_buffer_decode(&memLimit, 0, nullptr, data.data(), &inPos, data.size(), out.data(), &outPos, out.size());
+			return res == LZMA_OK && outPos == out.size();
+		}
+	case ArchiveCompression::Bz2:
+		{
+			if(data.size() > std::numeric_limits<unsigned int>::max() || out.size() > std::numeric_limits<unsigned int>::max())
+				return false;
+			auto outSize = static_cast<unsigned int>(out.size());
+			auto res = BZ2_bzBuffToBuffDecompress(reinterpret_cast<char *>(out.data()), &outSize, const_cast<char *>(reinterpret_cast<const char *>(data.data())), static_cast<unsigned int>(data.size()), 0, 0);
+			return res == BZ_OK && outSize == out.size();
+		}
+	}
+	return false;
+}
+
+std::optional<std::vector<uint8_t>> pragma::filesystem::archive::compress_chunked(ArchiveCompression compression, std::span<const uint8_t> data, uint32_t chunkSize, uint32_t level)
+{
+	if(compression == ArchiveCompression::None || chunkSize == 0)
+		return {};
+	auto chunkCount = (data.size() + chunkSize - 1) / chunkSize;
+	if(chunkCount > std::numeric_limits<uint32_t>::max())
+		return {};
+	ChunkTable table {chunkSize, static_cast<uint32_t>(chunkCount)};
+	std::vector<ChunkRecord> records(chunkCount);
+	std::vector<uint8_t> out(sizeof(ChunkTable) + chunkCount * sizeof(ChunkRecord));
+	auto anyCompressed = false;
+	for(size_t i = 0; i < chunkCount; ++i) {
+		auto offset = i * chunkSize;
+		auto chunk = data.subspan(offset, std::min<size_t>(chunkSize, data.size() - offset));
+		auto &record = records[i];
+		record.offset = out.size();
+		record.crc = crc32(chunk);
+		auto compressed = compress(compression, chunk, level);
+		if(compressed && compressed->size() < chunk.size()) {
+			out.insert(out.end(), compressed->begin(), compressed->end());
+			record.storedSize = static_cast<uint32_t>(compressed->size());
+			anyCompressed = true;
+		}
+		else {
+			out.insert(out.end(), chunk.begin(), chunk.end());
+			record.storedSize = static_cast<uint32_t>(chunk.size());
+		}
+	}
+	if(!anyCompressed)
+		return {};
+	std::memcpy(out.data(), &table, sizeof(table));
+	std::memcpy(out.data() + sizeof(table), records.data(), records.size() * sizeof(ChunkRecord));
+	return out;
+}
+
+bool pragma::filesystem::archive::read_chunk_table(std::span<const uint8_t> data, uint64_t size, ChunkTable &outTable)
+{
+	if(data.size() < sizeof(ChunkTable))
+		return false;
+	std::memcpy(&outTable, data.data(), sizeof(outTable));
+	if(outTable.chunkSize == 0 || outTable.chunkCount != (size + outTable.chunkSize - 1) / outTable.chunkSize)
+		return false;
+	if(outTable.chunkCount > (data.size() - sizeof(ChunkTable)) / sizeof(ChunkRecord))
+		return false;
+	for(uint32_t i = 0; i < outTable.chunkCount; ++i) {
+		auto record = get_chunk_record(data, i);
+		auto chunkSize = std::min<uint64_t>(outTable.chunkSize, size - static_cast<uint64_t>(i) * outTable.chunkSize);
+		if(record.offset > data.size() || record.storedSize > data.size() - record.offset || record.storedSize > chunkSize)
+			return false;
+	}
+	return true;
+}
+
+pragma::filesystem::archive::ChunkRecord pragma::filesystem::archive::get_chunk_record(std::span<const uint8_t> data, uint32_t index)
+{
+	// The chunk table isn't necessarily aligned within the mapped file
+	ChunkRecord record;
+	std::memcpy(&record, data.data() + sizeof(ChunkTable) + static_cast<size_t>(index) * sizeof(ChunkRecord), sizeof(record));
+	return record;
+}
+
+bool pragma::filesystem::archive::decompress_chunk(ArchiveCompression compression, std::span<const uint8_t> data, const ChunkRecord &record, std::span<uint8_t> out)
+{
+	auto stored = data.subspan(record.offset, record.storedSize);
+	if(!decompress((stored.size() == out.size()) ? ArchiveCompression::None : compression, stored, out))
+		return false;
+	return crc32(out) == record.crc;
+}
+
+///////////////////////////
+
+namespace {
+	struct BlockKeyHash {
+		size_t operator()(const pragma::filesystem::ArchiveBlockCache::Key &key) const
+		{
+			auto h = key.archive * 0x9E3779B97F4A7C15ull;
+			h ^= ((static_cast<uint64_t>(key.entry) << 32) | key.chunk) + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+			return static_cast<size_t>(h);
+		}
+	};
+	struct BlockCacheShard {
+		using Item = std::pair<pragma::filesystem::ArchiveBlockCache::Key, pragma::filesystem::ArchiveBlockCache::Block>;
+		std::mutex mutex;
+		// Most recently used blocks first
+		std::list<Item> blocks;
+		std::unordered_map<pragma::filesystem::ArchiveBlockCache::Key, std::list<Item>::iterator, BlockKeyHash> index;
+		uint64_t usage = 0;
+	};
+	struct BlockCache {
+		static constexpr size_t SHARD_COUNT = 16;
+		std::array<BlockCacheShard, SHARD_COUNT> shards;
+		std::atomic<uint64_t> budget {pragma::filesystem::ArchiveBlockCache::DEFAULT_MEMORY_BUDGET};
+		std::atomic<uint64_t> hits {0};
+		std::atomic<uint64_t> misses {0};
+		std::atomic<uint64_t> evictions {0};
+		BlockCacheShard &GetShard(const pragma::filesystem::ArchiveBlockCache::Key &key) { return shards[BlockKeyHash {}(key) % SHARD_COUNT]; }
+		uint64_t GetShardBudget() const { return budget / SHARD_COUNT; }
+	};
+}
+// Intentionally leaked, since archives may still be closed during static destruction
+static BlockCache &get_block_cache()
+{
+	static auto *cache = new BlockCache {};
+	return *cache;
+}
+
+// Has to be called with the shard mutex locked
+static void evict_blocks(BlockCacheShard &shard, uint64_t budget)
+{
+	auto &cache = get_block_cache();
+	while(shard.usage > budget && !shard.blocks.empty()) {
+		auto &item = shard.blocks.back();
+		shard.usage -= item.second->size();
+		shard.index.erase(item.first);
+		shard.blocks.pop_back();
+		++cache.evictions;
+	}
+}
+
+void pragma::filesystem::ArchiveBlockCache::SetMemoryBudget(uint64_t budget)
+{
+	auto &cache = get_block_cache();
+	cache.budget = budget;
+	auto shardBudget = cache.GetShardBudget();
+	for(auto &shard : cache.shards) {
+		std::scoped_lock lock {shard.mutex};
+		evict_blocks(shard, shardBudget);
+	}
+}
+uint64_t pragma::filesystem::ArchiveBlockCache::GetMemoryBudget() { return get_block_cache().budget; }
+
+pragma::filesystem::ArchiveBlockCache::Block pragma::filesystem::ArchiveBlockCache::Find(const Key &key)
+{
+	auto &cache = get_block_cache();
+	if(cache.budget == 0)
+		return nullptr;
+	auto &shard = cache.GetShard(key);
+	std::scoped_lock lock {shard.mutex};
+	auto it = shard.index.find(key);
+	if(it == shard.index.end()) {
+		++cache.misses;
+		return nullptr;
+	}
+	++cache.hits;
+	shard.blocks.splice(shard.blocks.begin(), shard.blocks, it->second);
+	return it->second->second;
+}
+
+void pragma::filesystem::ArchiveBlockCache::Insert(const Key &key, const Block &block)
+{
+	auto &cache = get_block_cache();
+	auto shardBudget = cache.GetShardBudget();
+	if(!block || block->size() > shardBudget)
+		return;
+	auto &shard = cache.GetShard(key);
+	std::scoped_lock lock {shard.mutex};
+	auto it = shard.index.find(key);
+	if(it != shard.index.end()) {
+		// Another reader decompressed the same block in the meantime
+		shard.blocks.splice(shard.blocks.begin(), shard.blocks, it->second);
+		return;
+	}
+	shard.blocks.emplace_front(key, block);
+	shard.index[key] = shard.blocks.begin();
+	shard.usage += block->size();
+	evict_blocks(shard, shardBudget);
+}
+
+void pragma::filesystem::ArchiveBlockCache::Remove(uint64_t archive)
+{
+	auto &cache = get_block_cache();
+	for(auto &shard : cache.shards) {
+		std::scoped_lock lock {shard.mutex};
+		for(auto it = shard.blocks.begin(); it != shard.blocks.end();) {
+			if(it->first.archive != archive) {
+				++it;
+				continue;
+			}
+			shard.usage -= it->second->size();
+			shard.index.erase(it->first);
+			it = shard.blocks.erase(it);
+		}
+	}
+}
+
+void pragma::filesystem::ArchiveBlockCache::Clear()
+{
+	auto &cache = get_block_cache();
+	for(auto &shard : cache.shards) {
+		std::scoped_lock lock {shard.mutex};
+		shard.blocks.clear();
+		shard.index.clear();
+		shard.usage = 0;
+	}
+}
+
+pragma::filesystem::ArchiveBlockCache::Statistics pragma::filesystem::ArchiveBlockCache::GetStatistics()
+{
+	auto &cache = get_block_cache();
+	Statistics stats {};
+	stats.hits = cache.hits;
+	stats.misses = cache.misses;
+	stats.evictions = cache.evictions;
+	for(auto &shard : cache.shards) {
+		std::scoped_lock lock {shard.mutex};
+		stats.blockCount += shard.blocks.size();
+		stats.memoryUsage += shard.usage;
+	}
+	return stats;
+}
+
+void pragma::filesystem::ArchiveBlockCache::ResetStatistics()
+{
+	auto &cache = get_block_cache();
+	cache.hits = 0;
+	cache.misses = 0;
+	cache.evictions = 0;
+}
+
+///////////////////////////
+
+std::shared_ptr<pragma::filesystem::VFilePtrInternalChunked> pragma::filesystem::VFilePtrInternalChunked::Create(std::span<const uint8_t> data, std::shared_ptr<const void> keepAlive, ArchiveCompression compression, uint64_t size, uint64_t cacheId, uint32_t entryIndex)
+{
+	archive::ChunkTable table;
+	if(!archive::read_chunk_table(data, size, table))
+		return nullptr;
+	std::shared_ptr<VFilePtrInternalChunked> f {new VFilePtrInternalChunked {}};
+	f->m_type = EVFile::Package;
+	f->m_bRead = true;
+	f->m_data = data;
+	f->m_keepAlive = std::move(keepAlive);
+	f->m_compression = compression;
+	f->m_size = size;
+	f->m_chunkSize = table.chunkSize;
+	f->m_chunkCount = table.chunkCount;
+	f->m_verifiedChunks.resize(table.chunkCount, false);
+	f->m_cacheId = cacheId;
+	f->m_entryIndex = entryIndex;
+	return f;
+}
+
+pragma::filesystem::VFilePtrInternalChunked::~VFilePtrInternalChunked() {}
+
+bool pragma::filesystem::VFilePtrInternalChunked::LoadChunk(uint32_t index)
+{
+	if(index == m_currentChunk)
+		return true;
+	auto record = archive::get_chunk_record(m_data, index);
+	auto chunkSize = std::min<unsigned long long>(m_chunkSize, m_size - static_cast<unsigned long long>(index) * m_chunkSize);
+	if(record.storedSize == chunkSize) {
+		auto chunk = m_data.subspan(record.offset, chunkSize);
+		// Raw chunks are read directly from the archive, but are still verified once
+		if(!m_verifiedChunks[index]) {
+			if(archive::crc32(chunk) != record.crc) {
+				m_currentChunk = INVALID_CHUNK;
+				m_block = nullptr;
+				m_chunk = {};
+				return false;
+			}
+			m_verifiedChunks[index] = true;
+		}
+		m_block = nullptr;
+		m_chunk = chunk;
+	}
+	else {
+		ArchiveBlockCache::Key key {m_cacheId, m_entryIndex, index};
+		auto block = (m_cacheId != 0) ? ArchiveBlockCache::Find(key) : nullptr;
+		if(!block) {
+			auto data = std::make_shared<std::vector<uint8_t>>(chunkSize);
+			if(!archive::decompress_chunk(m_compression, m_data, record, *data)) {
+				m_currentChunk = INVALID_CHUNK;
+				m_block = nullptr;
+				m_chunk = {};
+				return false;
+			}
+			block = data;
+			if(m_cacheId != 0)
+				ArchiveBlockCache::Insert(key, block);
+		}
+		m_block = block;
+		m_chunk = *m_block;
+	}
+	m_currentChunk = index;
+	return true;
+}
+
+size_t pragma::filesystem::VFilePtrInternalChunked::Read(void *ptr, size_t size)
+{
+	if(Eof() == EOF)
+		return 0;
+	size = std::min<unsigned long long>(size, m_size - m_offset);
+	auto *out = static_cast<uint8_t *>(ptr);
+	size_t read = 0;
+	while(read < size) {
+		auto index = static_cast<uint32_t>(m_offset / m_chunkSize);
+		if(!LoadChunk(index))
+			break;
+		auto chunkOffset = m_offset - static_cast<unsigned long long>(index) * m_chunkSize;
+		auto n = std::min<size_t>(size - read, m_chunk.size() - chunkOffset);
+		std::memcpy(out + read, m_chunk.data() + chunkOffset, n);
+		read += n;
+		m_offset += n;
+	}
+	return read;
+}
+
+unsigned long long pragma::filesystem::VFilePtrInternalChunked::Tell() { return m_offset; }
+
+void pragma::filesystem::VFilePtrInternalChunked::Seek(unsigned long long offset) { m_offset = offset; }
+
+int pragma::filesystem::VFilePtrInternalChunked::Eof() { return ((m_offset < m_size) ? 0 : EOF); }
+
+int pragma::filesystem::VFilePtrInternalChunked::ReadChar()
+{
+	if(Eof() == EOF)
+		return EOF;
+	auto index = static_cast<uint32_t>(m_offset / m_chunkSize);
+	if(!LoadChunk(index))
+		return EOF;
+	char c = m_chunk[m_offset - static_cast<unsigned long long>(index) * m_chunkSize];
+	m_offset++;
+	return c;
+}
+
+unsigned long long pragma::filesystem::VFilePtrInternalChunked::GetSize() { return m_size; }
+
+///////////////////////////
+
+static std::atomic<uint64_t> g_nextArchiveId {1};
+
+pragma::filesystem::ArchivePackage::ArchivePackage(SearchFlags searchFlags) : Package(searchFlags), m_id {g_nextArchiveId++} {}
+pragma::filesystem::ArchivePackage::~ArchivePackage() { ArchiveBlockCache::Remove(m_id); }
+
+std::unique_ptr<pragma::filesystem::ArchivePackage> pragma::filesystem::ArchivePackage::Open(const std::string &path, SearchFlags searchFlags, std::string *optOutErr)
+{
+	auto fail = [optOutErr](std::string err) -> std::unique_ptr<ArchivePackage> {
+		if(optOutErr)
+			*optOutErr = std::move(err);
+		return nullptr;
+	};
+	if constexpr(std::endian::native != std::endian::little)
+		return fail("archives are only supported on little-endian systems");
+	auto file = MappedFile::Open(path, optOutErr);
+	if(!file)
+		return nullptr;
+	auto data = file->GetData();
+	if(data.size() < sizeof(archive::Header))
+		return fail("file is too small");
+	archive::Header header;
+	std::memcpy(&header, data.data(), sizeof(header));
+	if(header.magic != archive::MAGIC)
+		return fail("not an archive");
+	if(header.version != archive::VERSION)
+		return fail("unsupported archive version " + std::to_string(header.version));
+	auto tocSize = static_cast<uint64_t>(header.entryCount) * sizeof(archive::EntryRecord);
+	if(header.tocOffset > data.size() || tocSize > data.size() - header.tocOffset || header.tocOffset % alignof(archive::EntryRecord) != 0)
+		return fail("invalid TOC");
+	if(header.stringTableOffset > data.size() || header.stringTableSize > data.size() - header.stringTableOffset)
+		return fail("invalid string table");
+	auto toc = data.subspan(header.tocOffset, tocSize);
+	auto strings = data.subspan(header.stringTableOffset, header.stringTableSize);
+	if(archive::crc32(strings, archive::crc32(toc)) != header.tocCrc)
+		return fail("TOC checksum mismatch");
+
+	std::unique_ptr<ArchivePackage> pck {new ArchivePackage {searchFlags}};
+	pck->m_path = path;
+	pck->m_file = file;
+	pck->m_entries = {reinterpret_cast<const archive::EntryRecord *>(toc.data()), header.entryCount};
+	pck->m_stringTable = {reinterpret_cast<const char *>(strings.data()), strings.size()};
+	for(auto &entry : pck->m_entries) {
+		if(entry.pathOffset > strings.size() || entry.pathLength > strings.size() - entry.pathOffset || entry.dataOffset > data.size() || entry.storedSize > data.size() - entry.dataOffset)
+			return fail("invalid TOC entry");
+	}
+	return pck;
+}
+
+std::string_view pragma::filesystem::ArchivePackage::GetEntryPath(const archive::EntryRecord &entry) const { return m_stringTable.substr(entry.pathOffset, entry.pathLength); }
+
+const pragma::filesystem::archive::EntryRecord *pragma::filesystem::ArchivePackage::FindEntry(const std::string_view &path) const
+{
+	auto normalizedPath = path;
+	while(!normalizedPath.empty() && (normalizedPath.front() == '/' || normalizedPath.front() == '\\'))
+		normalizedPath.remove_prefix(1);
+	auto hash = archive::hash_path(normalizedPath);
+	auto it = std::lower_bound(m_entries.begin(), m_entries.end(), hash, [](const archive::EntryRecord &entry, uint64_t hash) { return entry.pathHash < hash; });
+	for(; it != m_entries.end() && it->pathHash == hash; ++it) {
+		if(paths_equal(GetEntryPath(*it), normalizedPath))
+			return &*it;
+	}
+	return nullptr;
+}
+
+void pragma::filesystem::ArchivePackage::BuildDirectoryIndex() const
+{
+	std::call_once(m_directoryIndexBuilt, [this]() {
+		m_directoryIndex[""];
+		for(auto &entry : m_entries) {
+			auto path = GetEntryPath(entry);
+			std::string_view parent {};
+			size_t start = 0;
+			for(;;) {
+				auto sp = path.find('/', start);
+				if(sp == std::string_view::npos)
+					break;
+				auto dir = path.substr(0, sp);
+				auto [it, inserted] = m_directoryIndex.try_emplace(std::string {dir});
+				if(inserted)
+					m_directoryIndex[std::string {parent}].push_back({dir.substr(start), true, nullptr});
+				parent = dir;
+				start = sp + 1;
+			}
+			m_directoryIndex[std::string {parent}].push_back({path.substr(start), false, &entry});
+		}
+	});
+}
+
+bool pragma::filesystem::ArchivePackage::IsDirectory(const std::string_view &path) const
+{
+	auto key = normalize_archive_path(path);
+	if(key.empty())
+		return false;
+	BuildDirectoryIndex();
+	return m_directoryIndex.find(key) != m_directoryIndex.end();
+}
+
+std::shared_ptr<const pragma::filesystem::VFileStorage> pragma::filesystem::ArchivePackage::OpenEntry(const archive::EntryRecord &entry, std::string *optOutErr) const
+{
+	auto fail = [this, &entry, optOutErr](const std::string &err) -> std::shared_ptr<const VFileStorage> {
+		if(optOutErr)
+			*optOutErr = std::string {GetEntryPath(entry)} + ": " + err;
+		return nullptr;
+	};
+	auto data = m_file->GetData().subspan(entry.dataOffset, entry.storedSize);
+	if(entry.flags & archive::ENTRY_FLAG_CHUNKED) {
+		archive::ChunkTable table;
+		if(!archive::read_chunk_table(data, entry.size, table))
+			return fail("invalid chunk table");
+		auto out = std::make_shared<std::vector<uint8_t>>(entry.size);
+		auto entryIndex = static_cast<uint32_t>(&entry - m_entries.data());
+		for(uint32_t i = 0; i < table.chunkCount; ++i) {
+			auto offset = static_cast<uint64_t>(i) * table.chunkSize;
+			std::span<uint8_t> chunk {out->data() + offset, std::min<uint64_t>(table.chunkSize, entry.size - offset)};
+			auto record = archive::get_chunk_record(data, i);
+			if(record.storedSize != chunk.size()) {
+				auto block = ArchiveBlockCache::Find({m_id, entryIndex, i});
+				if(block && block->size() == chunk.size()) {
+					std::memcpy(chunk.data(), block->data(), chunk.size());
+					continue;
+				}
+			}
+			if(!archive::decompress_chunk(entry.compression, data, record, chunk))
+				return fail("chunk " + std::to_string(i) + " is damaged");
+		}
+		if(archive::crc32(*out) != entry.crc)
+			return fail("checksum mismatch");
+		return std::make_shared<VFileVectorStorage>(out);
+	}
+	if(entry.compression == ArchiveCompression::None) {
+		if(data.size() != entry.size)
+			return fail("size mismatch");
+		if(m_verifyUncompressed && archive::crc32(data) != entry.crc)
+			return fail("checksum mismatch");
+		return std::make_shared<VFileSpanStorage>(data, m_file);
+	}
+	// Entries that aren't chunked are cached as a single block
+	ArchiveBlockCache::Key key {m_id, static_cast<uint32_t>(&entry - m_entries.data()), 0};
+	if(auto block = ArchiveBlockCache::Find(key); block && block->size() == entry.size)
+		return std::make_shared<VFileSpanStorage>(*block, block);
+	auto out = std::make_shared<std::vector<uint8_t>>(entry.size);
+	if(!archive::decompress(entry.compression, data, *out))
+		return fail("decompression failed");
+	if(archive::crc32(*out) != entry.crc)
+		return fail("checksum mismatch");
+	ArchiveBlockCache::Insert(key, out);
+	return std::make_shared<VFileVectorStorage>(out);
+}
+
+pragma::filesystem::VFilePtr pragma::filesystem::ArchivePackage::OpenFile(const std::string_view &path, bool bBinary) const
+{
+	auto *entry = FindEntry(path);
+	if(!entry)
+		return nullptr;
+	if(entry->flags & archive::ENTRY_FLAG_CHUNKED) {
+		auto f = VFilePtrInternalChunked::Create(m_file->GetData().subspan(entry->dataOffset, entry->storedSize), m_file, entry->compression, entry->size, m_id, static_cast<uint32_t>(entry - m_entries.data()));
+		if(f)
+			f->m_bBinary = bBinary;
+		return f;
+	}
+	auto storage = OpenEntry(*entry);
+	if(!storage)
+		return nullptr;
+	auto f = std::make_shared<VFilePtrInternalVirtual>(storage);
+	f->m_type = EVFile::Package;
+	f->m_bBinary = bBinary;
+	f->m_bRead = true;
+	return f;
+}
+
+void pragma::filesystem::ArchivePackage::FindFiles(const std::string_view &path, const Glob &glob, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, bool bKeepPath) const
+{
+	BuildDirectoryIndex();
+	auto it = m_directoryIndex.find(normalize_archive_path(path));
+	if(it == m_directoryIndex.end())
+		return;
+	for(auto &child : it->second) {
+		auto *results = child.directory ? resdirs : resfiles;
+		if(!results)
+			continue;
+		if(!glob.Match(child.name))
+			continue;
+		results->push_back(bKeepPath ? (std::string {path} + std::string {child.name}) : std::string {child.name});
+	}
+}
+
+bool pragma::filesystem::ArchivePackage::VisitFiles(const std::string_view &path, const Glob &glob, const DirectoryVisitor &visitor, bool includeSize) const
+{
+	BuildDirectoryIndex();
+	auto it = m_directoryIndex.find(normalize_archive_path(path));
+	if(it == m_directoryIndex.end())
+		return true;
+	DirectoryEntry entry {};
+	entry.layer = FileLayer::Package;
+	for(auto &child : it->second) {
+		if(!glob.Match(child.name))
+			continue;
+		entry.name = child.name;
+		entry.directory = child.directory;
+		entry.size = {};
+		if(includeSize && child.entry)
+			entry.size = child.entry->size;
+		if(!visitor(entry))
+			return false;
+	}
+	return true;
+}
+
+bool pragma::filesystem::ArchivePackage::Verify(std::string *optOutErr) const
+{
+	for(auto &entry : m_entries) {
+		auto storage = OpenEntry(entry, optOutErr);
+		if(!storage)
+			return false;
+		if(entry.compression == ArchiveCompression::None && archive::crc32(storage->Map().data) != entry.crc) {
+			if(optOutErr)
+				*optOutErr = std::string {GetEntryPath(entry)} + ": checksum mismatch";
+			return false;
+		}
+	}
+	return true;
+}
+
+///////////////////////////
+
+pragma::filesystem::Package *pragma::filesystem::ArchivePackageManager::LoadPackage(std::string package, SearchFlags searchMode)
+{
+	std::string path;
+	if(std::filesystem::path {package}.is_absolute())
+		path = package;
+	else if(!FileManager::FindAbsolutePath(package, path, searchMode & ~(SearchFlags::Package | SearchFlags::Virtual)))
+		return nullptr;
+	for(auto &pck : m_packages) {
+		if(pck->GetPath() == path)
+			return pck.get();
+	}
+	auto pck = ArchivePackage::Open(path, searchMode);
+	if(!pck)
+		return nullptr;
+	m_packages.push_back(std::move(pck));
+	return m_packages.back().get();
+}
+
+void pragma::filesystem::ArchivePackageManager::ClearPackages(SearchFlags searchMode)
+{
+	auto it = std::remove_if(m_packages.begin(), m_packages.end(), [searchMode](const std::unique_ptr<ArchivePackage> &pck) { return (pck->GetSearchFlags() & searchMode) != SearchFlags::None; });
+	m_packages.erase(it, m_packages.end());
+}
+
+std::pair<const pragma::filesystem::ArchivePackage *, const pragma::filesystem::archive::EntryRecord *> pragma::filesystem::ArchivePackageManager::FindEntry(const std::string &path, SearchFlags includeFlags) const
+{
+	for(auto &pck : m_packages) {
+		if((pck->GetSearchFlags() & includeFlags) == SearchFlags::None)
+			continue;
+		auto *entry = pck->FindEntry(path);
+		if(entry)
+			return {pck.get(), entry};
+	}
+	return {nullptr, nullptr};
+}
+
+void pragma::filesystem::ArchivePackageManager::FindFiles(const std::string &target, const std::string &path, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, bool bKeepPath, SearchFlags includeFlags) const
+{
+	// target is the full search string, only the file name part is matched
+	auto br = target.find_last_of("/\\");
+	auto glob = Glob::Compile((br != std::string::npos) ? std::string_view {target}.substr(br + 1) : std::string_view {target}, false, Glob::Syntax::Wildcards);
+	impl::FindResultFilter fileFilter {resfiles, (resfiles != nullptr) ? resfiles->size() : 0};
+	impl::FindResultFilter dirFilter {resdirs, (resdirs != nullptr) ? resdirs->size() : 0};
+	for(auto &pck : m_packages) {
+		if((pck->GetSearchFlags() & includeFlags) == SearchFlags::None)
+			continue;
+		pck->FindFiles(path, glob, resfiles, resdirs, bKeepPath);
+		fileFilter.Commit();
+		dirFilter.Commit();
+	}
+}
+
+bool pragma::filesystem::ArchivePackageManager::VisitFiles(const std::string &target, const std::string &path, const DirectoryVisitor &visitor, bool includeSize, SearchFlags includeFlags) const
+{
+	auto br = target.find_last_of("/\\");
+	auto glob = Glob::Compile((br != std::string::npos) ? std::string_view {target}.substr(br + 1) : std::string_view {target}, false, Glob::Syntax::Wildcards);
+	// Entries of earlier packages take precedence
+	std::array<std::unordered_set<std::string_view, detail::CaseInsensitiveHash, detail::CaseInsensitiveEqual>, 2> visited;
+	std::vector<std::pair<std::string_view, bool>> pending;
+	for(auto &pck : m_packages) {
+		if((pck->GetSearchFlags() & includeFlags) == SearchFlags::None)
+			continue;
+		auto completed = pck->VisitFiles(path, glob, [&visitor, &visited, &pending](const DirectoryEntry &entry) {
+			if(visited[entry.directory].contains(entry.name))
+				return true;
+			pending.emplace_back(entry.name, entry.directory);
+			return visitor(entry);
+		}, includeSize);
+		if(!completed)
+			return false;
+		// Names point into the string tables of the packages, which stay valid
+		for(auto &[name, directory] : pending)
+			visited[directory].insert(name);
+		pending.clear();
+	}
+	return true;
+}
+
+bool pragma::filesystem::ArchivePackageManager::GetSize(const std::string &name, uint64_t &size) const
+{
+	auto [pck, entry] = FindEntry(name, SearchFlags::All);
+	if(!entry)
+		return false;
+	size = entry->size;
+	return true;
+}
+
+bool pragma::filesystem::ArchivePackageManager::Exists(const std::string &name, SearchFlags includeFlags) const
+{
+	if(FindEntry(name, includeFlags).second)
+		return true;
+	for(auto &pck : m_packages) {
+		if((pck->GetSearchFlags() & includeFlags) != SearchFlags::None && pck->IsDirectory(name))
+			return true;
+	}
+	return false;
+}
+
+bool pragma::filesystem::ArchivePackageManager::GetFileFlags(const std::string &name, SearchFlags includeFlags, FVFile &flags) const
+{
+	auto [pck, entry] = FindEntry(name, includeFlags);
+	if(entry) {
+		flags = FVFile::Package | FVFile::ReadOnly;
+		if(entry->compression != ArchiveCompression::None)
+			flags |= FVFile::Compressed;
+		return true;
+	}
+	for(auto &pck : m_packages) {
+		if((pck->GetSearchFlags() & includeFlags) != SearchFlags::None && pck->IsDirectory(name)) {
+			flags = FVFile::Package | FVFile::ReadOnly | FVFile::Directory;
+			return true;
+		}
+	}
+	return false;
+}
+
+pragma::filesystem::VFilePtr pragma::filesystem::ArchivePackageManager::OpenFile(const std::string &path, bool bBinary, SearchFlags includeFlags, SearchFlags excludeFlags) const
+{
+	auto [pck, entry] = FindEntry(path, includeFlags);
+	if(!entry)
+		return nullptr;
+	return pck->OpenFile(pck->GetEntryPath(*entry), bBinary);
+}
+
+bool pragma::filesystem::ArchivePackageManager::EnumerateFiles(const std::function<void(const EntryInfo &)> &callback) const
+{
+	EntryInfo info {};
+	for(auto &pck : m_packages) {
+		info.searchFlags = pck->GetSearchFlags();
+		for(auto &entry : pck->GetEntries()) {
+			info.path = pck->GetEntryPath(entry);
+			info.size = entry.size;
+			info.flags = FVFile::Package | FVFile::ReadOnly;
+			if(entry.compression != ArchiveCompression::None)
+				info.flags |= FVFile::Compressed;
+			callback(info);
+		}
+	}
+	return true;
+}
+
+///////////////////////////
+
+size_t pragma::filesystem::ArchiveWriter::AddBlob(std::shared_ptr<const std::vector<uint8_t>> data, ArchiveCompression compression, uint32_t chunkSize)
+{
+	return AddBlob([data = std::move(data)]() { return data; }, compression, chunkSize);
+}
+
+size_t pragma::filesystem::ArchiveWriter::AddBlob(Source source, ArchiveCompression compression, uint32_t chunkSize)
+{
+	m_blobs.push_back({std::move(source), compression, chunkSize});
+	return m_blobs.size() - 1;
+}
+
+bool pragma::filesystem::ArchiveWriter::AddEntry(std::string path, size_t blobIndex)
+{
+	path = normalize_archive_path(path);
+	if(path.empty() || blobIndex >= m_blobs.size() || !m_entryPaths.insert(path).second)
+		return false;
+	m_entries.push_back({std::move(path), blobIndex});
+	return true;
+}
+
+size_t pragma::filesystem::ArchiveWriter::AddFile(std::string path, std::shared_ptr<const std::vector<uint8_t>> data, ArchiveCompression compression, uint32_t chunkSize)
+{
+	path = normalize_archive_path(path);
+	if(path.empty() || m_entryPaths.contains(path))
+		return INVALID_BLOB;
+	auto blobIndex = AddBlob(std::move(data), compression, chunkSize);
+	AddEntry(std::move(path), blobIndex);
+	return blobIndex;
+}
+
+static uint64_t align_offset(uint64_t offset, uint64_t alignment) { return (offset + alignment - 1) / alignment * alignment; }
+
+struct pragma::filesystem::ArchiveWriter::EncodedBlob {
+	std::shared_ptr<const std::vector<uint8_t>> data;
+	ArchiveCompression compression = ArchiveCompression::None;
+	uint32_t crc = 0;
+	uint64_t size = 0;
+	uint8_t flags = 0;
+};
+
+namespace {
+	struct WrittenBlob {
+		uint64_t offset;
+		uint64_t storedSize;
+		uint64_t size;
+		uint32_t crc;
+		pragma::filesystem::ArchiveCompression compression;
+		uint8_t flags;
+	};
+}
+
+std::optional<pragma::filesystem::ArchiveWriter::EncodedBlob> pragma::filesystem::ArchiveWriter::EncodeBlob(size_t index) const
+{
+	auto &blob = m_blobs[index];
+	auto data = blob.source();
+	if(!data)
+		return {};
+	EncodedBlob encoded {data, ArchiveCompression::None, archive::crc32(*data), data->size(), 0};
+	if(blob.compression == ArchiveCompression::None)
+		return encoded;
+	if(blob.chunkSize > 0 && data->size() > blob.chunkSize) {
+		auto chunked = archive::compress_chunked(blob.compression, *data, blob.chunkSize, m_compressionLevel);
+		if(chunked && chunked->size() < data->size()) {
+			encoded.data = std::make_shared<const std::vector<uint8_t>>(std::move(*chunked));
+			encoded.compression = blob.compression;
+			encoded.flags = archive::ENTRY_FLAG_CHUNKED;
+		}
+		return encoded;
+	}
+	auto compressed = archive::compress(blob.compression, *data, m_compressionLevel);
+	if(compressed && compressed->size() < data->size()) {
+		encoded.data = std::make_shared<const std::vector<uint8_t>>(std::move(*compressed));
+		encoded.compression = blob.compression;
+	}
+	return encoded;
+}
+
+bool pragma::filesystem::ArchiveWriter::Write(const std::string &path, std::string *optOutErr) const
+{
+	auto fail = [optOutErr](std::string err) {
+		if(optOutErr)
+			*optOutErr = std::move(err);
+		return false;
+	};
+
+	auto f = FileManager::OpenSystemFile(path.c_str(), "wb", optOutErr);
+	if(!f)
+		return false;
+	uint64_t pos = 0;
+	auto writeData = [&f, &pos](const void *data, size_t size) {
+		if(size == 0)
+			return true;
+		pos += size;
+		return f->Write(data, size) == 1;
+	};
+	auto pad = [&writeData, &pos](uint64_t target) {
+		static constexpr std::array<uint8_t, 64> zeros {};
+		while(pos < target) {
+			if(!writeData(zeros.data(), std::min<uint64_t>(target - pos, zeros.size())))
+				return false;
+		}
+		return true;
+	};
+	// The header is written last, once all offsets are known
+	archive::Header header {};
+	if(!writeData(&header, sizeof(header)))
+		return fail("failed to write header");
+
+	// Blobs are encoded on the thread pool and written in order as soon as they're done.
+	// The number of blobs in flight is limited, so the memory usage doesn't depend on the size of the archive.
+	auto threadCount = (m_threadCount == 0) ? std::max(std::thread::hardware_concurrency(), 1u) : m_threadCount;
+	std::vector<WrittenBlob> written;
+	written.reserve(m_blobs.size());
+	auto writeBlob = [&](size_t index, std::optional<EncodedBlob> encoded) {
+		if(!encoded)
+			return fail("failed to read data of blob " + std::to_string(index));
+		// Only uncompressed data can be used in-place, so there's no point in aligning compressed data
+		if(encoded->compression == ArchiveCompression::None && !pad(align_offset(pos, m_alignment)))
+			return fail("failed to write file data");
+		written.push_back({pos, encoded->data->size(), encoded->size, encoded->crc, encoded->compression, encoded->flags});
+		if(!writeData(encoded->data->data(), encoded->data->size()))
+			return fail("failed to write file data");
+		return true;
+	};
+	if(threadCount <= 1) {
+		for(size_t i = 0; i < m_blobs.size(); ++i) {
+			if(!writeBlob(i, EncodeBlob(i)))
+				return false;
+		}
+	}
+	else {
+		BS::light_thread_pool pool {threadCount};
+		std::deque<std::future<std::optional<EncodedBlob>>> pending;
+		size_t next = 0;
+		for(size_t i = 0; i < m_blobs.size(); ++i) {
+			while(next < m_blobs.size() && pending.size() < threadCount * 2) {
+				pending.push_back(pool.submit_task([this, next]() { return EncodeBlob(next); }));
+				++next;
+			}
+			auto encoded = pending.front().get();
+			pending.pop_front();
+			if(!writeBlob(i, std::move(encoded))) {
+				pool.wait();
+				return false;
+			}
+		}
+	}
+
+	std::string stringTable;
+	std::vector<archive::EntryRecord> toc;
+	toc.reserve(m_entries.size());
+	for(auto &entry : m_entries) {
+		auto &blob = written[entry.blob];
+		archive::EntryRecord record {};
+		record.pathHash = archive::hash_path(entry.path);
+		record.dataOffset = blob.offset;
+		record.storedSize = blob.storedSize;
+		record.size = blob.size;
+		record.pathOffset = static_cast<uint32_t>(stringTable.size());
+		record.pathLength = static_cast<uint32_t>(entry.path.size());
+		record.crc = blob.crc;
+		record.compression = blob.compression;
+		record.flags = blob.flags;
+		stringTable += entry.path;
+		if(stringTable.size() > std::numeric_limits<uint32_t>::max())
+			return fail("string table exceeds maximum size");
+		toc.push_back(record);
+	}
+	std::sort(toc.begin(), toc.end(), [&stringTable](const archive::EntryRecord &a, const archive::EntryRecord &b) {
+		if(a.pathHash != b.pathHash)
+			return a.pathHash < b.pathHash;
+		return std::string_view {stringTable}.substr(a.pathOffset, a.pathLength) < std::string_view {stringTable}.substr(b.pathOffset, b.pathLength);
+	});
+
+	header.magic = archive::MAGIC;
+	header.version = archive::VERSION;
+	header.entryCount = static_cast<uint32_t>(toc.size());
+	header.tocOffset = align_offset(pos, alignof(archive::EntryRecord));
+	header.stringTableOffset = header.tocOffset + toc.size() * sizeof(archive::EntryRecord);
+	header.stringTableSize = stringTable.size();
+	std::span<const uint8_t> tocData {reinterpret_cast<const uint8_t *>(toc.data()), toc.size() * sizeof(archive::EntryRecord)};
+	std::span<const uint8_t> stringData {reinterpret_cast<const uint8_t *>(stringTable.data()), stringTable.size()};
+	header.tocCrc = archive::crc32(stringData, archive::crc32(tocData));
+
+	if(!pad(header.tocOffset) || !writeData(tocData.data(), tocData.size()) || !writeData(stringData.data(), stringData.size()))
+		return fail("failed to write TOC");
+	f->Seek(0);
+	if(f->Write(&header, sizeof(header)) != 1)
+		return fail("failed to write header");
+	return true;
+}
@@ -29,17 +29,29 @@ class DirectoryWatchListener : public efsw::FileWatchListener {
 	~DirectoryWatchListener();
 	void SetWatchId(efsw::WatchID watchId);
 	void SetEnabled(bool enabled);
+	void SetDebounceWindow(std::chrono::milliseconds window);
 	void handleFileAction(efsw::WatchID watchid, const std::string &dir, const std::string &filename, efsw::Action action, std::string oldFilename) override;
 
 	uint32_t Poll(const std::function<void(const std::string &, pragma::filesystem::FileWatcherEvent)> &onModified);
   private:
+	// Merged event of a file that hasn't been relayed yet
 	struct FileEvent {
-		FileEvent(const std::string &fName, pragma::filesystem::FileWatcherEvent event);
-		std::string fileName;
-		std::chrono::steady_clock::time_point time;
 		pragma::filesystem::FileWatcherEvent event;
+		// Identifies the queue entry that belongs to this event
+		uint64_t sequence;
+	};
+	struct QueueEntry {
+		std::chrono::steady_clock::time_point due;
+		uint64_t sequence;
+		std::string fileName;
+		bool operator>(const QueueEntry &other) const { return due > other.due || (due == other.due && sequence > other.sequence); }
 	};
 	std::unordered_map<std::string, FileEvent> m_fileStack;
+	// Ordered by due time, so Poll only has to look at the events that are due.
+	// Entries of events that were cancelled are skipped when they are popped.
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> m_eventQueue;
+	uint64_t m_nextSequence = 0;
+	std::chrono::milliseconds m_debounceWindow = pragma::filesystem::DirectoryWatcher::DEFAULT_DEBOUNCE_WINDOW;
 	std::atomic<bool> m_enabled = false;
 	std::mutex m_fileMutex;
 	pragma::util::Path m_rootPath;
@@ -58,9 +70,12 @@ DirectoryWatchListener::~DirectoryWatchListener()
 	m_watcherManager.lock()->RemoveWatch(m_watchId);
 }
 
-DirectoryWatchListener::FileEvent::FileEvent(const std::string &fName, pragma::filesystem::FileWatcherEvent event) : fileName(fName), event {event}, time(std::chrono::steady_clock::now()) {}
-
 void DirectoryWatchListener::SetWatchId(efsw::WatchID watchId) { m_watchId = watchId; }
+void DirectoryWatchListener::SetDebounceWindow(std::chrono::milliseconds window)
+{
+	std::unique_lock lock {m_fileMutex};
+	m_debounceWindow = window;
+}
 static pragma::filesystem::FileWatcherEvent efsw_action_to_pragma_event(efsw::Actions::Action action)
 {
 	switch(action) {
@@ -75,6 +90,32 @@ static pragma::filesystem::FileWatcherEvent efsw_action_to_pragma_event(efsw::Ac
 	}
 	return pragma::filesystem::FileWatcherEvent::Unknown;
 }
+// Combines a pending event with a later event for the same file. Returns an empty optional if the events cancel each other out.
+static std::optional<pragma::filesystem::FileWatcherEvent> merge_events(pragma::filesystem::FileWatcherEvent pending, pragma::filesystem::FileWatcherEvent next)
+{
+	using pragma::filesystem::FileWatcherEvent;
+	switch(next) {
+	case FileWatcherEvent::Delete:
+		// A file that was created and deleted again was never there
+		if(pending == FileWatcherEvent::Add)
+			return {};
+		return FileWatcherEvent::Delete;
+	case FileWatcherEvent::Add:
+		// Deleted and re-created, e.g. by editors that save to a temporary file
+		if(pending == FileWatcherEvent::Delete)
+			return FileWatcherEvent::Modified;
+		return pending;
+	case FileWatcherEvent::Modified:
+		if(pending == FileWatcherEvent::Delete)
+			return FileWatcherEvent::Modified;
+		return pending;
+	case FileWatcherEvent::Moved:
+		if(pending == FileWatcherEvent::Add)
+			return FileWatcherEvent::Add;
+		return FileWatcherEvent::Moved;
+	}
+	return next;
+}
 void DirectoryWatchListener::handleFileAction(efsw::WatchID watchid, const std::string &dir, const std::string &filename, efsw::Action action, std::string oldFilename)
 {
 	if(!m_enabled)
@@ -86,43 +127,55 @@ void DirectoryWatchListener::handleFileAction(efsw::WatchID watchid, const std::
 	path.MakeRelative(m_rootPath);
 	auto &normPath = path.GetString();
 	std::unique_lock lock {m_fileMutex};
-	if(m_fileStack.find(normPath) == m_fileStack.end()) {
-		FileEvent ev {normPath, event};
-		ev.time = std::chrono::steady_clock::now();
-		m_fileStack.insert(std::make_pair(normPath, ev));
+	auto it = m_fileStack.find(normPath);
+	if(it != m_fileStack.end()) {
+		// The event keeps the due time of the first event, so files that change constantly are still reported
+		auto merged = merge_events(it->second.event, event);
+		if(merged)
+			it->second.event = *merged;
+		else
+			m_fileStack.erase(it);
+		return;
 	}
+	auto sequence = m_nextSequence++;
+	m_fileStack.insert(std::make_pair(normPath, FileEvent {event, sequence}));
+	m_eventQueue.push({std::chrono::steady_clock::now() + m_debounceWindow, sequence, normPath});
 }
 
 uint32_t DirectoryWatchListener::Poll(const std::function<void(const std::string &, pragma::filesystem::FileWatcherEvent)> &onModified)
 {
-	uint32_t numChanged = 0;
-	std::unique_lock lock {m_fileMutex};
-	if(!m_fileStack.empty()) {
+	std::vector<std::pair<std::string, pragma::filesystem::FileWatcherEvent>> dueEvents;
+	{
+		std::unique_lock lock {m_fileMutex};
 		auto t = std::chrono::steady_clock::now();
-		for(auto it = m_fileStack.begin(); it != m_fileStack.end();) {
-			auto &name = it->first;
-			auto &item = it->second;
-			auto tDelta = std::chrono::duration_cast<std::chrono::milliseconds>(t - item.time).count();
-			if(tDelta <= 100) {
-				// Wait for a tenth of a second before relaying the event
-				++it;
+		while(!m_eventQueue.empty() && m_eventQueue.top().due <= t) {
+			auto entry = std::move(const_cast<QueueEntry &>(m_eventQueue.top()));
+			m_eventQueue.pop();
+			auto it = m_fileStack.find(entry.fileName);
+			if(it == m_fileStack.end() || it->second.sequence != entry.sequence)
 				continue;
-			}
-			++numChanged;
-			auto path = pragma::util::FilePath(item.fileName);
-			path.MakeRelative(m_rootPath);
-			onModified(path.GetString(), item.event);
-
-			it = m_fileStack.erase(it);
+			dueEvents.emplace_back(std::move(entry.fileName), it->second.event);
+			m_fileStack.erase(it);
 		}
 	}
-	return numChanged;
+	// The callbacks are called without the lock, so new events aren't blocked by them
+	for(auto &[fileName, event] : dueEvents) {
+		auto path = pragma::util::FilePath(fileName);
+		path.MakeRelative(m_rootPath);
+		onModified(path.GetString(), event);
+	}
+	return static_cast<uint32_t>(dueEvents.size());
 }
 
 namespace pragma::filesystem {
 	struct DirectoryWatchListenerSet {
 		DirectoryWatchListenerSet() = default;
 		std::vector<std::shared_ptr<DirectoryWatchListener>> listeners;
+		void SetDebounceWindow(std::chrono::milliseconds window)
+		{
+			for(auto &listener : listeners)
+				listener->SetDebounceWindow(window);
+		}
 		uint32_t Poll(const std::function<void(const std::string &, FileWatcherEvent)> &onModified)
 		{
 			uint32_t count = 0;
@@ -203,8 +256,10 @@ void pragma::filesystem::DirectoryWatcher::UpdateEnabledState()
 		auto recursive = math::is_flag_set(m_watchFlags, WatchFlags::WatchSubDirectories);
 		auto listenerSet = m_watcherManager.AddWatch(m_path, absolutePath, recursive);
 
-		if(listenerSet)
+		if(listenerSet) {
 			m_watchListenerSet = std::make_unique<DirectoryWatchListenerSet>(std::move(*listenerSet));
+			m_watchListenerSet->SetDebounceWindow(m_debounceWindow);
+		}
 	}
 	if(m_watchListenerSet) {
 		for(auto &listener : m_watchListenerSet->listeners)
@@ -219,6 +274,13 @@ void pragma::filesystem::DirectoryWatcher::SetEnabled(bool enabled)
 }
 bool pragma::filesystem::DirectoryWatcher::IsEnabled() const { return m_enabled; }
 
+void pragma::filesystem::DirectoryWatcher::SetDebounceWindow(std::chrono::milliseconds window)
+{
+	m_debounceWindow = window;
+	if(m_watchListenerSet)
+		m_watchListenerSet->SetDebounceWindow(window);
+}
+
 uint32_t pragma::filesystem::DirectoryWatcher::Poll()
 {
 	if(!m_watchListenerSet)
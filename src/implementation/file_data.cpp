@@ -9,6 +9,8 @@ module;
 #include <sys/stat.h>
 #elif _WIN32
 #include <Windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #endif
 
 module pragma.filesystem;
@@ -20,37 +22,548 @@ import :file_system;
 
 std::optional<std::wstring> string_to_wstring(const std::string &str);
 
-pragma::filesystem::VData::VData(std::string name) { m_name = name; }
+static constexpr unsigned char to_lower_ascii(unsigned char c) { return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + ('a' - 'A')) : c; }
+size_t pragma::filesystem::detail::CaseInsensitiveHash::operator()(const std::string_view &str) const
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for(auto c : str) {
+		hash ^= to_lower_ascii(static_cast<unsigned char>(c));
+		hash *= 1099511628211ull;
+	}
+	return static_cast<size_t>(hash);
+}
+bool pragma::filesystem::detail::CaseInsensitiveEqual::operator()(const std::string_view &a, const std::string_view &b) const
+{
+	if(a.length() != b.length())
+		return false;
+	for(size_t i = 0; i < a.length(); ++i) {
+		if(to_lower_ascii(static_cast<unsigned char>(a[i])) != to_lower_ascii(static_cast<unsigned char>(b[i])))
+			return false;
+	}
+	return true;
+}
+
+///////////////////////////
+
+pragma::filesystem::VData::VData(std::string name) : m_ownedName {std::move(name)}, m_name {m_ownedName} {}
+pragma::filesystem::VData::VData(InternedName name) : m_name {name.name} {}
 bool pragma::filesystem::VData::IsFile() { return false; }
 bool pragma::filesystem::VData::IsDirectory() { return false; }
-std::string pragma::filesystem::VData::GetName() { return m_name; }
+std::string_view pragma::filesystem::VData::GetName() const { return m_name; }
+pragma::filesystem::VirtualArena *pragma::filesystem::VData::GetArena() const { return m_arena; }
+
+///////////////////////////
+
+pragma::filesystem::VFileVectorStorage::VFileVectorStorage(const std::shared_ptr<std::vector<uint8_t>> &data) : m_data {data} {}
+unsigned long long pragma::filesystem::VFileVectorStorage::GetSize() const { return m_data->size(); }
+pragma::filesystem::VFileStorage::Mapping pragma::filesystem::VFileVectorStorage::Map() const { return {{m_data->data(), m_data->size()}, m_data}; }
+std::shared_ptr<std::vector<uint8_t>> pragma::filesystem::VFileVectorStorage::GetVector() const { return m_data; }
+
+pragma::filesystem::VFileSpanStorage::VFileSpanStorage(std::span<const uint8_t> data, const std::shared_ptr<const void> &keepAlive) : m_data {data}, m_keepAlive {keepAlive} {}
+unsigned long long pragma::filesystem::VFileSpanStorage::GetSize() const { return m_data.size(); }
+pragma::filesystem::VFileStorage::Mapping pragma::filesystem::VFileSpanStorage::Map() const { return {m_data, m_keepAlive}; }
+
+std::shared_ptr<pragma::filesystem::VFileMappedStorage> pragma::filesystem::VFileMappedStorage::Create(const std::string &path, size_t offset, size_t size, std::string *optOutErr)
+{
+	auto file = MappedFile::Open(path, optOutErr);
+	if(!file)
+		return nullptr;
+	return std::make_shared<VFileMappedStorage>(file, offset, size);
+}
+pragma::filesystem::VFileMappedStorage::VFileMappedStorage(const std::shared_ptr<MappedFile> &file, size_t offset, size_t size) : m_file {file}
+{
+	auto data = file->GetData();
+	offset = std::min(offset, data.size());
+	size = std::min(size, data.size() - offset);
+	m_data = data.subspan(offset, size);
+}
+unsigned long long pragma::filesystem::VFileMappedStorage::GetSize() const { return m_data.size(); }
+pragma::filesystem::VFileStorage::Mapping pragma::filesystem::VFileMappedStorage::Map() const { return {m_data, m_file}; }
+
+///////////////////////////
+
+struct pragma::filesystem::VFileGeneratorStorage::Slot {
+	// Guards data and size
+	std::mutex mutex;
+	std::shared_ptr<std::vector<uint8_t>> data;
+	std::optional<unsigned long long> size;
+	// Guarded by the cache mutex
+	bool cached = false;
+	std::list<std::shared_ptr<Slot>>::iterator cacheIt;
+};
+
+namespace {
+	struct GeneratorCache {
+		std::mutex mutex;
+		// Most recently used slots first
+		std::list<std::shared_ptr<pragma::filesystem::VFileGeneratorStorage::Slot>> slots;
+		uint64_t usage = 0;
+		std::atomic<uint64_t> budget {0};
+	};
+}
+// Intentionally leaked, since generator storages may still be destroyed during static destruction
+static GeneratorCache &get_generator_cache()
+{
+	static auto *cache = new GeneratorCache {};
+	return *cache;
+}
+
+// Has to be called with the cache mutex locked
+static void evict_generated_files()
+{
+	auto &cache = get_generator_cache();
+	auto budget = cache.budget.load();
+	if(budget == 0 || cache.slots.size() < 2)
+		return;
+	// The most recently used slot is always kept
+	auto it = cache.slots.end();
+	--it;
+	while(cache.usage > budget && it != cache.slots.begin()) {
+		auto &slot = *it;
+		// Slots that are currently being generated or read are skipped
+		std::unique_lock slotLock {slot->mutex, std::try_to_lock};
+		if(!slotLock.owns_lock()) {
+			--it;
+			continue;
+		}
+		cache.usage -= slot->data ? slot->data->size() : 0;
+		slot->data = nullptr;
+		slot->cached = false;
+		slotLock.unlock();
+		it = cache.slots.erase(it);
+		--it;
+	}
+}
+
+void pragma::filesystem::VFileGeneratorStorage::SetMemoryBudget(uint64_t budget)
+{
+	auto &cache = get_generator_cache();
+	std::scoped_lock lock {cache.mutex};
+	cache.budget = budget;
+	evict_generated_files();
+}
+uint64_t pragma::filesystem::VFileGeneratorStorage::GetMemoryBudget() { return get_generator_cache().budget; }
+uint64_t pragma::filesystem::VFileGeneratorStorage::GetMemoryUsage()
+{
+	auto &cache = get_generator_cache();
+	std::scoped_lock lock {cache.mutex};
+	return cache.usage;
+}
+
+pragma::filesystem::VFileGeneratorStorage::VFileGeneratorStorage(Generator generator, std::optional<unsigned long long> sizeHint) : m_generator {std::move(generator)}, m_sizeHint {sizeHint}, m_slot {std::make_shared<Slot>()} {}
+pragma::filesystem::VFileGeneratorStorage::~VFileGeneratorStorage() { Release(); }
+unsigned long long pragma::filesystem::VFileGeneratorStorage::GetSize() const
+{
+	{
+		std::scoped_lock lock {m_slot->mutex};
+		if(m_slot->size)
+			return *m_slot->size;
+	}
+	if(m_sizeHint)
+		return *m_sizeHint;
+	return Map().data.size();
+}
+pragma::filesystem::VFileStorage::Mapping pragma::filesystem::VFileGeneratorStorage::Map() const
+{
+	std::unique_lock slotLock {m_slot->mutex};
+	auto generated = false;
+	if(!m_slot->data) {
+		m_slot->data = std::make_shared<std::vector<uint8_t>>(m_generator());
+		m_slot->size = m_slot->data->size();
+		generated = true;
+	}
+	auto data = m_slot->data;
+	slotLock.unlock();
+
+	auto &cache = get_generator_cache();
+	std::scoped_lock lock {cache.mutex};
+	if(m_slot->cached)
+		cache.slots.splice(cache.slots.begin(), cache.slots, m_slot->cacheIt);
+	else if(generated) {
+		cache.slots.push_front(m_slot);
+		m_slot->cacheIt = cache.slots.begin();
+		m_slot->cached = true;
+		cache.usage += data->size();
+		evict_generated_files();
+	}
+	return {{data->data(), data->size()}, data};
+}
+bool pragma::filesystem::VFileGeneratorStorage::IsGenerated() const
+{
+	std::scoped_lock lock {m_slot->mutex};
+	return m_slot->data != nullptr;
+}
+void pragma::filesystem::VFileGeneratorStorage::Release() const
+{
+	auto &cache = get_generator_cache();
+	std::scoped_lock lock {cache.mutex, m_slot->mutex};
+	if(m_slot->cached) {
+		cache.usage -= m_slot->data ? m_slot->data->size() : 0;
+		cache.slots.erase(m_slot->cacheIt);
+		m_slot->cached = false;
+	}
+	m_slot->data = nullptr;
+}
 
 ///////////////////////////
 
-pragma::filesystem::VFile::VFile(const std::string &name, const std::shared_ptr<std::vector<uint8_t>> &data) : VData(name), m_data(data) {}
+pragma::filesystem::VFile::VFile(const std::string &name, const std::shared_ptr<std::vector<uint8_t>> &data) : VData(name), m_storage {std::make_shared<VFileVectorStorage>(data)} {}
+pragma::filesystem::VFile::VFile(InternedName name, const std::shared_ptr<std::vector<uint8_t>> &data) : VData(name), m_storage {std::make_shared<VFileVectorStorage>(data)} {}
+pragma::filesystem::VFile::VFile(const std::string &name, const std::shared_ptr<const VFileStorage> &storage) : VData(name), m_storage {storage} {}
+pragma::filesystem::VFile::VFile(InternedName name, const std::shared_ptr<const VFileStorage> &storage) : VData(name), m_storage {storage} {}
 bool pragma::filesystem::VFile::IsFile() { return true; }
-unsigned long long pragma::filesystem::VFile::GetSize() { return m_data->size(); }
-std::shared_ptr<std::vector<uint8_t>> pragma::filesystem::VFile::GetData() const { return m_data; }
+unsigned long long pragma::filesystem::VFile::GetSize() { return m_storage->GetSize(); }
+std::shared_ptr<std::vector<uint8_t>> pragma::filesystem::VFile::GetData() const { return m_storage->GetVector(); }
+pragma::filesystem::VFileStorage::Mapping pragma::filesystem::VFile::Map() const { return m_storage->Map(); }
+const std::shared_ptr<const pragma::filesystem::VFileStorage> &pragma::filesystem::VFile::GetStorage() const { return m_storage; }
 
 ///////////////////////////
 
 pragma::filesystem::VDirectory::VDirectory(std::string name) : VData(name) {}
-pragma::filesystem::VDirectory::VDirectory() : VData("root") {}
-pragma::filesystem::VDirectory::~VDirectory()
+pragma::filesystem::VDirectory::VDirectory(VirtualArena &childArena) : VData(std::string {"root"}), m_childArena {&childArena} {}
+pragma::filesystem::VDirectory::VDirectory(InternedName name, VirtualArena &childArena) : VData(name), m_childArena {&childArena} {}
+pragma::filesystem::VDirectory::VDirectory() : VData(std::string {"root"}) {}
+pragma::filesystem::VDirectory::~VDirectory() { Clear(); }
+void pragma::filesystem::VDirectory::DestroyChild(VData *file)
 {
-	for(unsigned int i = 0; i < m_files.size(); i++)
-		delete m_files[i];
+	auto *arena = file->GetArena();
+	if(arena)
+		arena->Destroy(*file);
+	else
+		delete file;
+}
+void pragma::filesystem::VDirectory::Clear()
+{
+	auto files = std::move(m_files);
+	m_files.clear();
+	m_fileIndex.clear();
+	m_directoryIndex.clear();
+	for(auto *file : files)
+		DestroyChild(file);
 }
-std::vector<pragma::filesystem::VData *> &pragma::filesystem::VDirectory::GetFiles() { return m_files; }
+const std::vector<pragma::filesystem::VData *> &pragma::filesystem::VDirectory::GetFiles() const { return m_files; }
 bool pragma::filesystem::VDirectory::IsDirectory() { return true; }
-void pragma::filesystem::VDirectory::Add(VData *file) { m_files.push_back(file); }
+void pragma::filesystem::VDirectory::Add(VData *file)
+{
+	m_files.push_back(file);
+	// If a child with the same name already exists, it keeps precedence
+	if(file->IsFile())
+		m_fileIndex.emplace(file->GetName(), static_cast<VFile *>(file));
+	else if(file->IsDirectory())
+		m_directoryIndex.emplace(file->GetName(), static_cast<VDirectory *>(file));
+}
 void pragma::filesystem::VDirectory::Remove(VData *file)
 {
 	auto it = std::find(m_files.begin(), m_files.end(), file);
 	if(it == m_files.end())
 		return;
 	m_files.erase(it);
-	delete file;
+	auto removeFromIndex = [this, file](auto &index) {
+		auto itIndex = index.find(std::string_view {file->GetName()});
+		if(itIndex == index.end() || itIndex->second != file)
+			return;
+		index.erase(itIndex);
+		// Another child with the same name may have been shadowed by the removed one
+		for(auto *child : m_files) {
+			if(child->IsFile() == file->IsFile() && detail::CaseInsensitiveEqual {}(child->GetName(), file->GetName())) {
+				index.emplace(child->GetName(), static_cast<typename std::remove_reference_t<decltype(index)>::mapped_type>(child));
+				break;
+			}
+		}
+	};
+	if(file->IsFile())
+		removeFromIndex(m_fileIndex);
+	else
+		removeFromIndex(m_directoryIndex);
+	DestroyChild(file);
+}
+
+///////////////////////////
+
+pragma::filesystem::VirtualArena::VirtualArena() : m_resource {64 * 1024} { m_names.emplace(&m_resource); }
+pragma::filesystem::VirtualArena::~VirtualArena() { Clear(); }
+void *pragma::filesystem::VirtualArena::Allocate(size_t size, size_t alignment)
+{
+	auto it = m_freeBlocks.find({size, alignment});
+	if(it != m_freeBlocks.end() && !it->second.empty()) {
+		auto *block = it->second.back();
+		it->second.pop_back();
+		return block;
+	}
+	return m_resource.allocate(size, alignment);
+}
+void pragma::filesystem::VirtualArena::Register(VData &node, const Slot &slot)
+{
+	node.m_arena = this;
+	if(!m_freeSlots.empty()) {
+		node.m_arenaIndex = m_freeSlots.back();
+		m_freeSlots.pop_back();
+		m_nodes[node.m_arenaIndex] = slot;
+	}
+	else {
+		node.m_arenaIndex = m_nodes.size();
+		m_nodes.push_back(slot);
+	}
+	++m_nodeCount;
+}
+std::string_view pragma::filesystem::VirtualArena::Intern(const std::string_view &str)
+{
+	auto it = m_names->find(str);
+	if(it != m_names->end())
+		return *it;
+	auto *data = static_cast<char *>(m_resource.allocate(str.length(), alignof(char)));
+	std::memcpy(data, str.data(), str.length());
+	return *m_names->insert(std::string_view {data, str.length()}).first;
+}
+void pragma::filesystem::VirtualArena::Destroy(VData &node)
+{
+	auto index = node.m_arenaIndex;
+	auto slot = m_nodes[index];
+	m_nodes[index] = {};
+	--m_nodeCount;
+	std::destroy_at(&node);
+	m_freeBlocks[{slot.size, slot.alignment}].push_back(slot.memory);
+	m_freeSlots.push_back(index);
+}
+void pragma::filesystem::VirtualArena::Clear()
+{
+	// Destroying a directory destroys its children as well, so slots may be cleared while iterating
+	for(size_t i = 0; i < m_nodes.size(); ++i) {
+		auto *node = m_nodes[i].node;
+		if(!node)
+			continue;
+		Destroy(*node);
+	}
+	m_nodes.clear();
+	m_freeSlots.clear();
+	m_freeBlocks.clear();
+	m_nodeCount = 0;
+	m_names.reset();
+	m_resource.release();
+	m_names.emplace(&m_resource);
+}
+
+///////////////////////////
+
+// ASCII case-insensitive ordering of the children of a snapshot entry
+static bool name_less(const std::string_view &a, const std::string_view &b)
+{
+	auto n = std::min(a.length(), b.length());
+	for(size_t i = 0; i < n; ++i) {
+		auto ca = to_lower_ascii(static_cast<unsigned char>(a[i]));
+		auto cb = to_lower_ascii(static_cast<unsigned char>(b[i]));
+		if(ca != cb)
+			return ca < cb;
+	}
+	return a.length() < b.length();
+}
+template<class TChildren>
+static auto find_child(TChildren &children, const std::string_view &name)
+{
+	auto it = std::lower_bound(children.begin(), children.end(), name, [](const pragma::filesystem::VirtualSnapshot::Child &child, const std::string_view &name) { return name_less(child.name, name); });
+	if(it != children.end() && !pragma::filesystem::detail::CaseInsensitiveEqual {}(it->name, name))
+		it = children.end();
+	return it;
+}
+
+pragma::filesystem::VirtualSnapshot::VirtualSnapshot() : m_root {std::make_shared<Entry>(Entry {.directory = true})} {}
+const pragma::filesystem::VirtualSnapshot::Entry *pragma::filesystem::VirtualSnapshot::Find(const std::string_view &path) const
+{
+	std::string normalizedPath;
+	std::string_view remaining = path;
+	if(remaining.find("..") != std::string_view::npos) {
+		normalizedPath = FileManager::GetNormalizedPath(std::string {remaining});
+		remaining = normalizedPath;
+	}
+	const Entry *entry = m_root.get();
+	while(!remaining.empty()) {
+		auto sp = remaining.find_first_of("/\\");
+		auto component = remaining.substr(0, sp);
+		remaining = (sp != std::string_view::npos) ? remaining.substr(sp + 1) : std::string_view {};
+		if(component.empty() || component == ".")
+			continue;
+		auto it = find_child(entry->children, component);
+		if(it == entry->children.end())
+			return nullptr;
+		entry = it->entry.get();
+	}
+	return (entry != m_root.get()) ? entry : nullptr;
+}
+const pragma::filesystem::VirtualSnapshot::Entry &pragma::filesystem::VirtualSnapshot::GetRoot() const { return *m_root; }
+std::shared_ptr<const pragma::filesystem::VirtualSnapshot> pragma::filesystem::VirtualSnapshot::Build(VDirectory &root)
+{
+	auto snapshot = std::make_shared<VirtualSnapshot>();
+	auto entry = std::make_shared<Entry>(Entry {.directory = true});
+	Build(root, *entry);
+	snapshot->m_root = std::move(entry);
+	return snapshot;
+}
+void pragma::filesystem::VirtualSnapshot::Build(VDirectory &dir, Entry &dirEntry)
+{
+	for(auto *child : dir.GetFiles()) {
+		auto name = child->GetName();
+		auto it = std::lower_bound(dirEntry.children.begin(), dirEntry.children.end(), name, [](const Child &child, const std::string_view &name) { return name_less(child.name, name); });
+		std::shared_ptr<Entry> entry;
+		if(it != dirEntry.children.end() && detail::CaseInsensitiveEqual {}(it->name, name))
+			entry = std::const_pointer_cast<Entry>(it->entry);
+		else {
+			entry = std::make_shared<Entry>(Entry {.name = std::string {name}});
+			dirEntry.children.insert(it, {entry->name, entry});
+		}
+		// If multiple children share the same name, the first one takes precedence, same as for VDirectory lookups
+		if(child->IsFile()) {
+			if(entry->file)
+				continue;
+			entry->file = true;
+			entry->storage = static_cast<VFile *>(child)->GetStorage();
+		}
+		else if(child->IsDirectory()) {
+			if(entry->directory)
+				continue;
+			entry->directory = true;
+			Build(*static_cast<VDirectory *>(child), *entry);
+		}
+	}
+}
+std::shared_ptr<const pragma::filesystem::VirtualSnapshot::Entry> pragma::filesystem::VirtualSnapshot::SetFile(const Entry &dir, std::span<const std::string_view> components, const std::shared_ptr<const VFileStorage> &storage)
+{
+	auto name = components.front();
+	auto it = find_child(dir.children, name);
+	auto *existing = (it != dir.children.end()) ? it->entry.get() : nullptr;
+	std::shared_ptr<const Entry> child;
+	if(components.size() > 1) {
+		// Removing a file from a directory that doesn't exist is a no-op
+		if(!storage && (!existing || !existing->directory))
+			return nullptr;
+		if(existing && existing->directory)
+			child = SetFile(*existing, components.subspan(1), storage);
+		else {
+			Entry subDir {.name = std::string {name}, .directory = true};
+			if(existing) {
+				subDir.file = existing->file;
+				subDir.storage = existing->storage;
+			}
+			child = SetFile(subDir, components.subspan(1), storage);
+		}
+		if(!child)
+			return nullptr;
+	}
+	else {
+		if(!storage && (!existing || !existing->file))
+			return nullptr;
+		auto entry = std::make_shared<Entry>(existing ? Entry {*existing} : Entry {.name = std::string {name}});
+		entry->file = (storage != nullptr);
+		entry->storage = storage;
+		child = std::move(entry);
+	}
+	// Only the entries along the path are copied, everything else is shared with the previous snapshot
+	auto copy = std::make_shared<Entry>(dir);
+	auto itCopy = copy->children.begin() + (it - dir.children.begin());
+	if(!child->file && !child->directory)
+		copy->children.erase(itCopy);
+	else if(existing)
+		*itCopy = {child->name, child};
+	else {
+		itCopy = std::lower_bound(copy->children.begin(), copy->children.end(), name, [](const Child &child, const std::string_view &name) { return name_less(child.name, name); });
+		copy->children.insert(itCopy, {child->name, child});
+	}
+	return copy;
+}
+static void split_path_components(const std::string_view &path, std::vector<std::string_view> &outComponents)
+{
+	std::string_view remaining = path;
+	while(!remaining.empty()) {
+		auto sp = remaining.find_first_of("/\\");
+		auto component = remaining.substr(0, sp);
+		remaining = (sp != std::string_view::npos) ? remaining.substr(sp + 1) : std::string_view {};
+		if(!component.empty() && component != ".")
+			outComponents.push_back(component);
+	}
+}
+std::shared_ptr<const pragma::filesystem::VirtualSnapshot> pragma::filesystem::VirtualSnapshot::SetFile(const std::string_view &path, const std::shared_ptr<const VFileStorage> &storage) const
+{
+	std::vector<std::string_view> components;
+	split_path_components(path, components);
+	if(components.empty())
+		return nullptr;
+	auto root = SetFile(*m_root, components, storage);
+	if(!root)
+		return nullptr;
+	auto snapshot = std::make_shared<VirtualSnapshot>();
+	snapshot->m_root = std::move(root);
+	return snapshot;
+}
+std::shared_ptr<const pragma::filesystem::VirtualSnapshot::Entry> pragma::filesystem::VirtualSnapshot::AddFiles(const Entry *existing, const std::string_view &name, std::span<const FileUpdate> files, size_t depth)
+{
+	auto entry = std::make_shared<Entry>();
+	if(existing) {
+		entry->name = existing->name;
+		entry->file = existing->file;
+		entry->directory = existing->directory;
+		entry->storage = existing->storage;
+	}
+	else
+		entry->name = std::string {name};
+	// Files that end at this entry come first, since they are a prefix of all other paths in the range.
+	// If the same path was added multiple times, the first one takes precedence.
+	auto it = files.begin();
+	if(it != files.end() && it->components.size() == depth) {
+		entry->file = true;
+		entry->storage = it->storage;
+	}
+	while(it != files.end() && it->components.size() == depth)
+		++it;
+	if(it == files.end()) {
+		if(existing)
+			entry->children = existing->children;
+		return entry;
+	}
+	entry->directory = true;
+
+	// Merge the sorted children with the sorted groups of files below them. Unaffected children are shared with the previous snapshot.
+	auto oldChildren = existing ? std::span<const Child> {existing->children} : std::span<const Child> {};
+	entry->children.reserve(oldChildren.size() + (files.end() - it));
+	auto itOld = oldChildren.begin();
+	while(it != files.end()) {
+		auto childName = it->components[depth];
+		auto itEnd = std::find_if(it + 1, files.end(), [depth, &childName](const FileUpdate &file) { return !detail::CaseInsensitiveEqual {}(file.components[depth], childName); });
+		for(; itOld != oldChildren.end() && name_less(itOld->name, childName); ++itOld)
+			entry->children.push_back(*itOld);
+		const Entry *existingChild = nullptr;
+		if(itOld != oldChildren.end() && !name_less(childName, itOld->name))
+			existingChild = (itOld++)->entry.get();
+		auto child = AddFiles(existingChild, childName, files.subspan(it - files.begin(), itEnd - it), depth + 1);
+		entry->children.push_back({child->name, child});
+		it = itEnd;
+	}
+	entry->children.insert(entry->children.end(), itOld, oldChildren.end());
+	return entry;
+}
+std::shared_ptr<const pragma::filesystem::VirtualSnapshot> pragma::filesystem::VirtualSnapshot::AddFiles(std::span<const std::pair<std::string_view, std::shared_ptr<const VFileStorage>>> files) const
+{
+	std::vector<std::string_view> components;
+	std::vector<std::pair<size_t, size_t>> ranges;
+	ranges.reserve(files.size());
+	for(auto &[path, storage] : files) {
+		auto offset = components.size();
+		split_path_components(path, components);
+		ranges.push_back({offset, components.size() - offset});
+	}
+	std::vector<FileUpdate> updates;
+	updates.reserve(files.size());
+	for(size_t i = 0; i < files.size(); ++i) {
+		auto [offset, count] = ranges[i];
+		if(count > 0)
+			updates.push_back({std::span<const std::string_view> {components}.subspan(offset, count), files[i].second});
+	}
+	if(updates.empty())
+		return nullptr;
+	// Sorting groups the files by directory, so that every entry on their paths only has to be rebuilt once
+	std::stable_sort(updates.begin(), updates.end(), [](const FileUpdate &a, const FileUpdate &b) { return std::lexicographical_compare(a.components.begin(), a.components.end(), b.components.begin(), b.components.end(), name_less); });
+	auto snapshot = std::make_shared<VirtualSnapshot>();
+	snapshot->m_root = AddFiles(m_root.get(), {}, updates, 0);
+	return snapshot;
 }
 
 ///////////////////////////
@@ -76,13 +589,64 @@ void pragma::filesystem::VFilePtrInternal::Seek(unsigned long long offset, int w
 int pragma::filesystem::VFilePtrInternal::Eof() { return 0; }
 int pragma::filesystem::VFilePtrInternal::ReadChar() { return 0; }
 unsigned long long pragma::filesystem::VFilePtrInternal::GetSize() { return 0; }
+std::span<const uint8_t> pragma::filesystem::VFilePtrInternal::GetMemory() { return {}; }
+
+static bool is_whitespace_char(int c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f'; }
+// Characters that can be part of a number accepted by std::from_chars, including "inf" and "nan"
+static bool is_number_char(int c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '+' || c == '-' || c == '.'; }
+
+void pragma::filesystem::VFilePtrInternal::UnreadChar(int c) { Seek(Tell() - 1); }
+
+std::optional<std::string_view> pragma::filesystem::VFilePtrInternal::ScanNumber(std::span<char> buffer, std::optional<unsigned long long> &outMemoryOffset)
+{
+	auto mem = GetMemory();
+	if(mem.data() != nullptr) {
+		auto *data = reinterpret_cast<const char *>(mem.data());
+		auto pos = std::min<unsigned long long>(Tell(), mem.size());
+		while(pos < mem.size() && is_whitespace_char(data[pos]))
+			++pos;
+		outMemoryOffset = pos;
+		return std::string_view {data + pos, static_cast<size_t>(mem.size() - pos)};
+	}
+	// Reads through the buffered stream, so that only the character after the number has to be put back
+	auto c = ReadChar();
+	while(is_whitespace_char(c))
+		c = ReadChar();
+	size_t n = 0;
+	while(c != EOF && is_number_char(c)) {
+		if(n == buffer.size()) {
+			// The number is too long and would be cut off
+			UnreadChar(c);
+			Seek(Tell() - n);
+			return {};
+		}
+		buffer[n++] = static_cast<char>(c);
+		c = ReadChar();
+	}
+	if(c != EOF)
+		UnreadChar(c);
+	return std::string_view {buffer.data(), n};
+}
+
+void pragma::filesystem::VFilePtrInternal::FinishNumber(const std::string_view &text, size_t parsedLength, const std::optional<unsigned long long> &memoryOffset)
+{
+	if(memoryOffset) {
+		Seek(*memoryOffset + parsedLength);
+		return;
+	}
+	// Characters that were read but don't belong to the number (rare, e.g. "5abc") have to be put back
+	if(parsedLength < text.size())
+		Seek(Tell() - (text.size() - parsedLength));
+}
 
 pragma::filesystem::FVFile pragma::filesystem::VFilePtrInternal::GetFlags() const
 {
 	FVFile flags = FVFile::None;
 	switch(m_type) {
 	case EVFile::Virtual:
-		flags |= (FVFile::ReadOnly | FVFile::Virtual);
+		flags |= FVFile::Virtual;
+		if(!m_bWritable)
+			flags |= FVFile::ReadOnly;
 		break;
 	case EVFile::Local:
 		break;
@@ -329,15 +893,22 @@ void pragma::filesystem::VFilePtrInternal::IgnoreComments(std::string start, std
 
 ///////////////////////////
 
-pragma::filesystem::VFilePtrInternalVirtual::VFilePtrInternalVirtual(VFile *file) : VFilePtrInternal()
+pragma::filesystem::VFilePtrInternalVirtual::VFilePtrInternalVirtual(VFile *file) : VFilePtrInternalVirtual(file->GetStorage()) {}
+pragma::filesystem::VFilePtrInternalVirtual::VFilePtrInternalVirtual(const std::shared_ptr<std::vector<uint8_t>> &data) : VFilePtrInternalVirtual(std::make_shared<VFileVectorStorage>(data)) {}
+pragma::filesystem::VFilePtrInternalVirtual::VFilePtrInternalVirtual(const std::shared_ptr<const VFileStorage> &storage) : VFilePtrInternal(), m_storage {storage}
 {
 	m_offset = 0;
 	m_type = EVFile::Virtual;
-	m_file = file;
+	m_mapping = storage->Map();
+	m_data = m_mapping.data.data();
+	m_size = m_mapping.data.size();
 }
 pragma::filesystem::VFilePtrInternalVirtual::~VFilePtrInternalVirtual() {}
-unsigned long long pragma::filesystem::VFilePtrInternalVirtual::GetSize() { return m_file->GetSize(); }
-std::shared_ptr<std::vector<uint8_t>> pragma::filesystem::VFilePtrInternalVirtual::GetData() const { return m_file->GetData(); }
+unsigned long long pragma::filesystem::VFilePtrInternalVirtual::GetSize() { return m_size; }
+std::span<const uint8_t> pragma::filesystem::VFilePtrInternalVirtual::GetMemory() { return m_mapping.data; }
+std::shared_ptr<std::vector<uint8_t>> pragma::filesystem::VFilePtrInternalVirtual::GetData() const { return m_storage->GetVector(); }
+const pragma::filesystem::VFileStorage::Mapping &pragma::filesystem::VFilePtrInternalVirtual::Map() const { return m_mapping; }
+const std::shared_ptr<const pragma::filesystem::VFileStorage> &pragma::filesystem::VFilePtrInternalVirtual::GetStorage() const { return m_storage; }
 
 ///////////////////////////
 
@@ -356,21 +927,6 @@ pragma::filesystem::VFilePtrInternalReal::~VFilePtrInternalReal()
 }
 const std::string &pragma::filesystem::VFilePtrInternalReal::GetPath() const { return m_path; }
 
-#ifdef __linux__
-static bool is_directory(FILE *f)
-{
-	if(!f)
-		return false;
-	int fd = fileno(f);
-	if(fd == -1)
-		return false;
-	struct stat st;
-	if(fstat(fd, &st) != 0)
-		return false;
-	return S_ISDIR(st.st_mode);
-}
-#endif
-
 bool pragma::filesystem::VFilePtrInternalReal::Construct(const char *path, const char *mode, int *optOutErrno, std::string *optOutErr)
 {
 	std::string sPath = path;
@@ -382,7 +938,7 @@ bool pragma::filesystem::VFilePtrInternalReal::Construct(const char *path, const
 		if(optOutErrno)
 			*optOutErrno = 0;
 		if(optOutErr)
-			*optOutErr = "failed to convert UTF‑8 path to UTF‑16";
+			*optOutErr = "failed to convert UTF-8 path to UTF-16";
 		return false;
 	}
 	auto wmode = pragma::string::string_to_wstring(mode);
@@ -417,23 +973,33 @@ bool pragma::filesystem::VFilePtrInternalReal::Construct(const char *path, const
 		return false;
 	}
 
+	// The size is taken from the open handle, which doesn't require seeking
 #ifdef __linux__
+	struct stat st;
+	auto hasStat = fstat(fileno(m_file), &st) == 0;
 	// Linux allows opening directories as files, but we want to
 	// disallow that.
-	if(is_directory(m_file)) {
+	if(hasStat && S_ISDIR(st.st_mode)) {
 		if(optOutErrno)
 			*optOutErrno = EISDIR;
 		if(optOutErr)
 			*optOutErr = std::strerror(EISDIR);
 		return false;
 	}
+#else
+	struct _stat64 st;
+	auto hasStat = _fstat64(_fileno(m_file), &st) == 0;
 #endif
 
 	m_path = std::move(sPath);
-	long long cur = ftell(m_file);
-	fseek(m_file, 0, SEEK_END);
-	m_size = ftell(m_file);
-	fseek(m_file, static_cast<long>(cur), SEEK_SET);
+	if(hasStat)
+		m_size = st.st_size;
+	else {
+		long long cur = ftell(m_file);
+		fseek(m_file, 0, SEEK_END);
+		m_size = ftell(m_file);
+		fseek(m_file, static_cast<long>(cur), SEEK_SET);
+	}
 	return true;
 }
 
@@ -24,6 +24,42 @@ static bool path_to_string(const std::filesystem::path &path, std::string &str)
 	}
 	return false;
 }
+// Key of the secondary index: '/' as separator, no leading or trailing separators
+static std::string normalize_index_path(const std::string_view &path)
+{
+	std::string normPath {path};
+	std::replace(normPath.begin(), normPath.end(), '\\', '/');
+	auto start = normPath.find_first_not_of('/');
+	if(start == std::string::npos)
+		return {};
+	auto end = normPath.find_last_not_of('/');
+	return normPath.substr(start, end - start + 1);
+}
+static std::string get_extension_key(const std::string_view &path)
+{
+	auto dot = path.rfind('.');
+	if(dot == std::string_view::npos || path.find('/', dot) != std::string_view::npos)
+		return {};
+	std::string ext {path.substr(dot + 1)};
+	pragma::string::to_lower(ext);
+	return ext;
+}
+static bool starts_with_case_insensitive(const std::string_view &str, const std::string_view &prefix)
+{
+	if(str.size() < prefix.size())
+		return false;
+	for(size_t i = 0; i < prefix.size(); ++i) {
+		if(std::tolower(static_cast<unsigned char>(str[i])) != std::tolower(static_cast<unsigned char>(prefix[i])))
+			return false;
+	}
+	return true;
+}
+
+bool pragma::filesystem::FileIndexCache::PathLess::operator()(const std::string_view &a, const std::string_view &b) const
+{
+	return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](char ca, char cb) { return std::tolower(static_cast<unsigned char>(ca)) < std::tolower(static_cast<unsigned char>(cb)); });
+}
+
 size_t pragma::filesystem::FileIndexCache::Hash(const std::string_view &key, bool isAbsolutePath) const
 {
 	// djb2 hash
@@ -88,6 +124,8 @@ void pragma::filesystem::FileIndexCache::Add(const std::string_view &path, Type
 #ifdef VFILESYSTEM_STORE_FILE_INDEX_CACHE_PATHS
 	m_indexCache[hash].path = std::string {path};
 #endif
+	if(m_secondaryIndexEnabled)
+		AddToSecondaryIndex(path, type);
 }
 void pragma::filesystem::FileIndexCache::Remove(const std::string_view &path)
 {
@@ -97,6 +135,89 @@ void pragma::filesystem::FileIndexCache::Remove(const std::string_view &path)
 	if(it == m_indexCache.end())
 		return;
 	m_indexCache.erase(it);
+	if(m_secondaryIndexEnabled)
+		RemoveFromSecondaryIndex(path);
+}
+
+void pragma::filesystem::FileIndexCache::AddToSecondaryIndex(const std::string_view &path, Type type)
+{
+	auto normPath = normalize_index_path(path);
+	if(normPath.empty())
+		return;
+	auto it = m_sortedPaths.find(normPath);
+	if(it != m_sortedPaths.end()) {
+		if(it->second == type)
+			return;
+		RemoveFromSecondaryIndex(normPath);
+	}
+	it = m_sortedPaths.emplace(std::move(normPath), type).first;
+	if(type != Type::File)
+		return;
+	auto ext = get_extension_key(it->first);
+	if(!ext.empty())
+		m_extensionIndex[std::move(ext)].insert(it->first);
+}
+
+void pragma::filesystem::FileIndexCache::RemoveFromSecondaryIndex(const std::string_view &path)
+{
+	auto it = m_sortedPaths.find(normalize_index_path(path));
+	if(it == m_sortedPaths.end())
+		return;
+	if(it->second == Type::File) {
+		auto itExt = m_extensionIndex.find(get_extension_key(it->first));
+		if(itExt != m_extensionIndex.end()) {
+			itExt->second.erase(it->first);
+			if(itExt->second.empty())
+				m_extensionIndex.erase(itExt);
+		}
+	}
+	m_sortedPaths.erase(it);
+}
+
+void pragma::filesystem::FileIndexCache::SetSecondaryIndexEnabled(bool enabled)
+{
+	if(enabled == m_secondaryIndexEnabled)
+		return;
+	m_secondaryIndexEnabled = enabled;
+	if(!enabled) {
+		std::unique_lock lock {m_cacheMutex};
+		m_sortedPaths.clear();
+		m_extensionIndex.clear();
+		return;
+	}
+	if(!m_rootPath.empty())
+		Reset(m_rootPath);
+}
+
+std::vector<std::string> pragma::filesystem::FileIndexCache::FindFilesByExtension(const std::string_view &extension, const std::string_view &dir) const
+{
+	std::string key {(!extension.empty() && extension.front() == '.') ? extension.substr(1) : extension};
+	pragma::string::to_lower(key);
+	auto prefix = normalize_index_path(dir);
+	if(!prefix.empty())
+		prefix += '/';
+	std::vector<std::string> paths;
+	std::unique_lock lock {m_cacheMutex};
+	auto it = m_extensionIndex.find(key);
+	if(it == m_extensionIndex.end())
+		return paths;
+	for(auto itPath = it->second.lower_bound(prefix); itPath != it->second.end() && starts_with_case_insensitive(*itPath, prefix); ++itPath)
+		paths.emplace_back(*itPath);
+	return paths;
+}
+
+std::vector<std::string> pragma::filesystem::FileIndexCache::FindItems(const Glob &glob, Type type) const
+{
+	auto &prefix = glob.GetLiteralPrefix();
+	std::vector<std::string> paths;
+	std::unique_lock lock {m_cacheMutex};
+	for(auto it = m_sortedPaths.lower_bound(prefix); it != m_sortedPaths.end() && starts_with_case_insensitive(it->first, prefix); ++it) {
+		if(type != Type::Invalid && it->second != type)
+			continue;
+		if(glob.Match(it->first))
+			paths.push_back(it->first);
+	}
+	return paths;
 }
 
 std::optional<pragma::filesystem::FileIndexCache::ItemInfo> pragma::filesystem::FileIndexCache::FindItemInfo(std::string path) const
@@ -123,6 +244,8 @@ void pragma::filesystem::FileIndexCache::Reset(std::string rootPath)
 	m_pending = 0;
 	Wait();
 	m_indexCache.clear();
+	m_sortedPaths.clear();
+	m_extensionIndex.clear();
 
 	m_rootPath = std::move(rootPath);
 	QueuePath(m_rootPath);
@@ -172,11 +295,14 @@ void pragma::filesystem::FileIndexCache::DecrementPending()
 void pragma::filesystem::FileIndexCache::IterateFiles(size_t rootLen, const std::filesystem::directory_entry &path)
 {
 	std::vector<std::pair<size_t, ItemInfo>> localCache;
-	auto addItem = [this, &localCache, rootLen](const std::filesystem::path &path, ItemInfo info) {
+	std::vector<std::pair<std::string, Type>> localPaths;
+	auto addItem = [this, &localCache, &localPaths, rootLen](const std::filesystem::path &path, ItemInfo info) {
 		std::string strPath;
 		if(path_to_string(path, strPath) == false)
 			return;
 		auto hash = Hash(strPath.substr(rootLen), false);
+		if(m_secondaryIndexEnabled)
+			localPaths.emplace_back(strPath.substr(rootLen), info.type);
 #ifdef VFILESYSTEM_STORE_FILE_INDEX_CACHE_PATHS
 		info.path = strPath.substr(rootLen);
 #endif
@@ -203,6 +329,8 @@ void pragma::filesystem::FileIndexCache::IterateFiles(size_t rootLen, const std:
 	m_indexCache.reserve(m_indexCache.size() + localCache.size());
 	for(auto &pair : localCache)
 		m_indexCache[std::move(pair.first)] = pair.second;
+	for(auto &[path, type] : localPaths)
+		AddToSecondaryIndex(path, type);
 	m_cacheMutex.unlock();
 }
 
@@ -224,6 +352,7 @@ void pragma::filesystem::RootPathFileCacheManager::AddRootReadOnlyLocation(const
 	if(identifier == "primary")
 		throw std::runtime_error {"'primary' root location is reserved"};
 	auto cache = std::make_unique<FileIndexCache>();
+	cache->SetSecondaryIndexEnabled(m_secondaryIndexEnabled);
 	cache->Reset(std::string {rootPath});
 	m_caches[identifier] = std::move(cache);
 }
@@ -280,3 +409,35 @@ bool pragma::filesystem::RootPathFileCacheManager::Exists(std::string path) cons
 }
 void pragma::filesystem::RootPathFileCacheManager::Add(const std::string_view &path, FileIndexCache::Type type) { m_primaryCache->Add(path, type); }
 void pragma::filesystem::RootPathFileCacheManager::Remove(const std::string_view &path) { m_primaryCache->Remove(path); }
+
+void pragma::filesystem::RootPathFileCacheManager::SetSecondaryIndexEnabled(bool enabled)
+{
+	m_secondaryIndexEnabled = enabled;
+	for(auto &[name, cache] : m_caches)
+		cache->SetSecondaryIndexEnabled(enabled);
+}
+static void append_unique_paths(std::vector<std::string> &paths, std::unordered_set<std::string> &lowerCasePaths, std::vector<std::string> &&newPaths)
+{
+	for(auto &path : newPaths) {
+		auto lowerCasePath = path;
+		pragma::string::to_lower(lowerCasePath);
+		if(lowerCasePaths.insert(std::move(lowerCasePath)).second)
+			paths.push_back(std::move(path));
+	}
+}
+std::vector<std::string> pragma::filesystem::RootPathFileCacheManager::FindFilesByExtension(const std::string_view &extension, const std::string_view &dir) const
+{
+	std::vector<std::string> paths;
+	std::unordered_set<std::string> lowerCasePaths;
+	for(auto &[name, cache] : m_caches)
+		append_unique_paths(paths, lowerCasePaths, cache->FindFilesByExtension(extension, dir));
+	return paths;
+}
+std::vector<std::string> pragma::filesystem::RootPathFileCacheManager::FindItems(const Glob &glob, FileIndexCache::Type type) const
+{
+	std::vector<std::string> paths;
+	std::unordered_set<std::string> lowerCasePaths;
+	for(auto &[name, cache] : m_caches)
+		append_unique_paths(paths, lowerCasePaths, cache->FindItems(glob, type));
+	return paths;
+}
@@ -14,6 +14,10 @@ size_t pragma::filesystem::File::Read(void *data, size_t size) { return m_file->
 size_t pragma::filesystem::File::Write(const void *data, size_t size)
 {
 	auto type = m_file->GetType();
+	if(type == EVFile::Virtual) {
+		auto *f = dynamic_cast<VFilePtrInternalMemory *>(m_file.get());
+		return f ? f->Write(data, size) : 0;
+	}
 	if(type != EVFile::Local)
 		return 0;
 	return static_cast<VFilePtrInternalReal *>(m_file.get())->Write(data, size);
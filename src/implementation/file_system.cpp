@@ -9,14 +9,18 @@ module;
 #include <sys/stat.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <cerrno>
 #define DIR_SEPARATOR '/'
 #define DIR_SEPARATOR_OTHER '\\'
+#define LOCAL_PATHS_CASE_SENSITIVE true
 
 #elif _WIN32
 
 #include "Shlwapi.h"
 #define DIR_SEPARATOR '\\'
 #define DIR_SEPARATOR_OTHER '/'
+#define LOCAL_PATHS_CASE_SENSITIVE false
 #include <wchar.h>
 
 #endif
@@ -26,6 +30,7 @@ module;
 module pragma.filesystem;
 
 import :file_system;
+import :glob;
 import :mount;
 import :util;
 
@@ -142,7 +147,8 @@ DLLFSYSTEM
 #endif
   pragma::filesystem::VFilePtrReal pragma::filesystem::FileManager::OpenFile<pragma::filesystem::VFilePtrReal>(const char *cpath, const char *mode, std::string *optOutErr, SearchFlags includeFlags, SearchFlags excludeFlags)
 {
-	return std::static_pointer_cast<VFilePtrInternalReal>(OpenFile(cpath, mode, optOutErr, includeFlags, excludeFlags));
+	// Files in the writable virtual overlay are not real files
+	return std::dynamic_pointer_cast<VFilePtrInternalReal>(OpenFile(cpath, mode, optOutErr, includeFlags, excludeFlags));
 }
 
 template<>
@@ -151,18 +157,180 @@ DLLFSYSTEM
 #endif
   pragma::filesystem::VFilePtrVirtual pragma::filesystem::FileManager::OpenFile<pragma::filesystem::VFilePtrVirtual>(const char *cpath, const char *mode, std::string *optOutErr, SearchFlags includeFlags, SearchFlags excludeFlags)
 {
-	return std::static_pointer_cast<VFilePtrInternalVirtual>(OpenFile(cpath, mode, optOutErr, includeFlags, excludeFlags));
+	return std::dynamic_pointer_cast<VFilePtrInternalVirtual>(OpenFile(cpath, mode, optOutErr, includeFlags, excludeFlags));
 }
 
-decltype(pragma::filesystem::FileManager::m_vroot) pragma::filesystem::FileManager::m_vroot;
+decltype(pragma::filesystem::FileManager::m_virtualArena) pragma::filesystem::FileManager::m_virtualArena;
+decltype(pragma::filesystem::FileManager::m_vroot) pragma::filesystem::FileManager::m_vroot {m_virtualArena};
 decltype(pragma::filesystem::FileManager::m_packages) pragma::filesystem::FileManager::m_packages;
 decltype(pragma::filesystem::FileManager::m_customMount) pragma::filesystem::FileManager::m_customMount;
 decltype(pragma::filesystem::FileManager::m_rootPath) pragma::filesystem::FileManager::m_rootPath;
 decltype(pragma::filesystem::FileManager::m_customFileHandler) pragma::filesystem::FileManager::m_customFileHandler = nullptr;
 
 static std::shared_mutex g_customMountMutex {};
-static std::mutex g_packageMutex {};
+// Lookups only need a shared lock; registering, loading and clearing packages requires exclusive access
+static std::shared_mutex g_packageMutex {};
+// Package managers in registration order, which is also their priority order
+static std::vector<pragma::filesystem::PackageManager *> g_packageManagers {};
+
+namespace {
+	// Combined file index of all package managers that support PackageManager::EnumerateFiles
+	struct PackageIndex {
+		struct Entry {
+			pragma::filesystem::PackageManager *manager;
+			// Position of the manager in g_packageManagers
+			size_t order;
+			uint64_t size;
+			pragma::filesystem::FVFile flags;
+			pragma::filesystem::SearchFlags searchFlags;
+			// Next entry with the same path, or NO_ENTRY
+			uint32_t next;
+		};
+		static constexpr uint32_t NO_ENTRY = std::numeric_limits<uint32_t>::max();
+		std::vector<Entry> entries;
+		// Path -> First entry with that path
+		std::unordered_map<std::string, uint32_t, pragma::filesystem::detail::CaseInsensitiveHash, pragma::filesystem::detail::CaseInsensitiveEqual> files;
+		// Managers without enumeration support with their position in g_packageManagers
+		std::vector<std::pair<size_t, pragma::filesystem::PackageManager *>> unindexed;
+
+		void Build();
+		void Add(const std::string_view &path, const Entry &entry);
+		const Entry *Find(const std::string &path, pragma::filesystem::SearchFlags includeFlags) const;
+		// Returns the next lower priority entry with the same path
+		const Entry *Next(const Entry &entry, pragma::filesystem::SearchFlags includeFlags) const;
+		// Calls f for each manager that may contain the path, in priority order, until f returns true.
+		// entry is nullptr for managers that aren't indexed.
+		template<typename TFunc>
+		bool Visit(const std::string &path, pragma::filesystem::SearchFlags includeFlags, const TFunc &f) const
+		{
+			auto *entry = Find(path, includeFlags);
+			for(auto &[order, manager] : unindexed) {
+				for(; entry && entry->order < order; entry = Next(*entry, includeFlags)) {
+					if(f(*entry->manager, entry))
+						return true;
+				}
+				if(f(*manager, nullptr))
+					return true;
+			}
+			// If opening the file fails, a lower priority duplicate may still succeed
+			for(; entry; entry = Next(*entry, includeFlags)) {
+				if(f(*entry->manager, entry))
+					return true;
+			}
+			return false;
+		}
+	};
+}
+
+void PackageIndex::Add(const std::string_view &path, const Entry &entry)
+{
+	auto idx = static_cast<uint32_t>(entries.size());
+	auto [it, inserted] = files.try_emplace(std::string {path}, idx);
+	if(!inserted) {
+		auto *prev = &entries[it->second];
+		for(;;) {
+			// Directories are derived from every file below them, but only need one entry per package
+			if(pragma::math::is_flag_set(entry.flags, pragma::filesystem::FVFile::Directory) && prev->manager == entry.manager && prev->flags == entry.flags && prev->searchFlags == entry.searchFlags)
+				return;
+			if(prev->next == NO_ENTRY)
+				break;
+			prev = &entries[prev->next];
+		}
+		// Lower priority duplicate, append it to the chain
+		prev->next = idx;
+	}
+	entries.push_back(entry);
+}
+
+void PackageIndex::Build()
+{
+	for(size_t i = 0; i < g_packageManagers.size(); ++i) {
+		auto *manager = g_packageManagers[i];
+		auto supported = manager->EnumerateFiles([this, manager, i](const pragma::filesystem::PackageManager::EntryInfo &info) {
+			Add(info.path, {manager, i, info.size, info.flags, info.searchFlags, NO_ENTRY});
+			// Parent directories aren't reported by the managers
+			auto dirFlags = (info.flags & ~pragma::filesystem::FVFile::Compressed) | pragma::filesystem::FVFile::Directory;
+			std::string_view dir = info.path;
+			for(auto br = dir.rfind('/'); br != std::string_view::npos && br > 0; br = dir.rfind('/')) {
+				dir = dir.substr(0, br);
+				Add(dir, {manager, i, 0, dirFlags, info.searchFlags, NO_ENTRY});
+			}
+		});
+		if(!supported)
+			unindexed.push_back({i, manager});
+	}
+}
+
+const PackageIndex::Entry *PackageIndex::Find(const std::string &path, pragma::filesystem::SearchFlags includeFlags) const
+{
+	if(files.empty())
+		return nullptr;
+	thread_local std::string key;
+	key = path;
+	std::replace(key.begin(), key.end(), '\\', '/');
+	while(!key.empty() && key.back() == '/')
+		key.pop_back();
+	auto it = files.find(key);
+	if(it == files.end())
+		return nullptr;
+	auto &entry = entries[it->second];
+	if((entry.searchFlags & includeFlags) != pragma::filesystem::SearchFlags::None)
+		return &entry;
+	return Next(entry, includeFlags);
+}
+
+const PackageIndex::Entry *PackageIndex::Next(const Entry &entry, pragma::filesystem::SearchFlags includeFlags) const
+{
+	for(auto idx = entry.next; idx != NO_ENTRY; idx = entries[idx].next) {
+		auto &next = entries[idx];
+		if((next.searchFlags & includeFlags) != pragma::filesystem::SearchFlags::None)
+			return &next;
+	}
+	return nullptr;
+}
+
+static std::mutex g_packageIndexMutex {};
+static std::atomic<std::shared_ptr<const PackageIndex>> g_packageIndex {};
+static std::atomic<bool> g_packageIndexDirty {true};
+
+// Has to be called with g_packageMutex locked exclusively
+static void invalidate_package_index() { g_packageIndexDirty.store(true, std::memory_order_release); }
+
+// Has to be called with g_packageMutex locked. The index is rebuilt lazily, so that loading many packages only rebuilds it once.
+static std::shared_ptr<const PackageIndex> get_package_index()
+{
+	if(!g_packageIndexDirty.load(std::memory_order_acquire))
+		return g_packageIndex.load(std::memory_order_acquire);
+	std::scoped_lock lock {g_packageIndexMutex};
+	if(g_packageIndexDirty.load(std::memory_order_acquire)) {
+		auto index = std::make_shared<PackageIndex>();
+		index->Build();
+		g_packageIndex.store(std::move(index), std::memory_order_release);
+		g_packageIndexDirty.store(false, std::memory_order_release);
+	}
+	return g_packageIndex.load(std::memory_order_acquire);
+}
 static std::shared_mutex g_rootPathMutex {};
+// Guards modifications of the virtual file tree. Readers use the published snapshot instead.
+static std::mutex g_virtualMutex {};
+static std::atomic<std::shared_ptr<const pragma::filesystem::VirtualSnapshot>> g_virtualSnapshot {};
+static std::shared_ptr<const pragma::filesystem::VirtualSnapshot> load_virtual_snapshot()
+{
+	auto snapshot = g_virtualSnapshot.load(std::memory_order_acquire);
+	if(snapshot)
+		return snapshot;
+	// Nothing has been published yet
+	static auto empty = std::make_shared<const pragma::filesystem::VirtualSnapshot>();
+	return empty;
+}
+// Writable virtual overlay. Lock order is g_virtualMutex before g_overlayMutex.
+static std::mutex g_overlayMutex {};
+// Published like the virtual snapshot so that readers can check writability without locking. Modified under g_overlayMutex.
+static std::atomic<std::shared_ptr<const std::vector<std::string>>> g_overlayPaths {std::make_shared<const std::vector<std::string>>()};
+// Bytes reserved by each committed overlay file
+static std::unordered_map<std::string, uint64_t, pragma::filesystem::detail::CaseInsensitiveHash, pragma::filesystem::detail::CaseInsensitiveEqual> g_overlayFiles {};
+static std::atomic<uint64_t> g_overlayUsage {0};
+static std::atomic<uint64_t> g_overlayBudget {0};
 
 void pragma::filesystem::FileManager::SetCustomFileHandler(const std::function<VFilePtr(const std::string &, const char *mode)> &fHandler) { m_customFileHandler = fHandler; }
 
@@ -229,30 +397,320 @@ void pragma::filesystem::FileManager::ClearCustomMountDirectories()
 
 #define NormalizePath(path) path = pragma::fs::get_normalized_path(path);
 
-std::pair<pragma::filesystem::VDirectory *, pragma::filesystem::VFile *> pragma::filesystem::FileManager::AddVirtualFile(std::string path, const std::shared_ptr<std::vector<uint8_t>> &data)
+std::pair<pragma::filesystem::VDirectory *, pragma::filesystem::VFile *> pragma::filesystem::FileManager::AddVirtualFile(std::string path, const std::shared_ptr<std::vector<uint8_t>> &data) { return AddVirtualFile(std::move(path), std::make_shared<VFileVectorStorage>(data)); }
+
+std::pair<pragma::filesystem::VDirectory *, pragma::filesystem::VFile *> pragma::filesystem::FileManager::AddVirtualFile(std::string path, const std::shared_ptr<const VFileStorage> &storage)
+{
+	std::scoped_lock lock {g_virtualMutex};
+	auto snapshot = load_virtual_snapshot();
+	auto result = AddVirtualFileUnlocked(std::move(path), storage, snapshot);
+	g_virtualSnapshot.store(std::move(snapshot), std::memory_order_release);
+	return result;
+}
+
+std::pair<pragma::filesystem::VDirectory *, pragma::filesystem::VFile *> pragma::filesystem::FileManager::AddVirtualFileUnlocked(std::string path, const std::shared_ptr<const VFileStorage> &storage, std::shared_ptr<const VirtualSnapshot> &snapshot)
+{
+	auto [dir, f] = AddVirtualFileToTree(path, storage);
+	// An existing file with the same name keeps precedence
+	if(auto newSnapshot = snapshot->SetFile(path, dir->GetFile(f->GetName())->GetStorage()))
+		snapshot = std::move(newSnapshot);
+	return {dir, f};
+}
+
+void pragma::filesystem::FileManager::AddVirtualFilesUnlocked(std::span<std::pair<std::string, std::shared_ptr<const VFileStorage>>> files, std::shared_ptr<const VirtualSnapshot> &snapshot)
+{
+	std::vector<std::pair<VDirectory *, VFile *>> added;
+	added.reserve(files.size());
+	for(auto &[path, storage] : files)
+		added.push_back(AddVirtualFileToTree(path, storage));
+	std::vector<std::pair<std::string_view, std::shared_ptr<const VFileStorage>>> updates;
+	updates.reserve(files.size());
+	for(size_t i = 0; i < files.size(); ++i) {
+		auto [dir, f] = added[i];
+		// An existing file with the same name keeps precedence
+		updates.push_back({files[i].first, dir->GetFile(f->GetName())->GetStorage()});
+	}
+	if(auto newSnapshot = snapshot->AddFiles(updates))
+		snapshot = std::move(newSnapshot);
+}
+
+std::pair<pragma::filesystem::VDirectory *, pragma::filesystem::VFile *> pragma::filesystem::FileManager::AddVirtualFileToTree(std::string &path, const std::shared_ptr<const VFileStorage> &storage)
 {
 	std::replace(path.begin(), path.end(), DIR_SEPARATOR_OTHER, DIR_SEPARATOR);
 
 	NormalizePath(path);
-	unsigned int cur = 0;
-	std::string sub;
+	string::to_lower(path);
+	std::string_view name = path;
 	VDirectory *dir = &m_vroot;
-	while(cur < path.size() && path[cur] != '\0') {
-		if(path[cur] == '/' || path[cur] == '\\') {
-			string::to_lower(sub);
-			dir = dir->AddDirectory(sub);
-			sub = "";
-		}
-		else
-			sub += path[cur];
-		cur++;
+	auto br = name.find_last_of("/\\");
+	if(br != std::string_view::npos) {
+		dir = dir->AddDirectory(name.substr(0, br));
+		name = name.substr(br + 1);
 	}
-	string::to_lower(sub);
-	VFile *f = new VFile(sub, data);
+	auto *f = m_virtualArena.Create<VFile>(VData::InternedName {m_virtualArena.Intern(name)}, storage);
 	dir->Add(f);
 	return {dir, f};
 }
 
+void pragma::filesystem::FileManager::ClearVirtualFiles()
+{
+	std::scoped_lock lock {g_virtualMutex};
+	m_vroot.Clear();
+	m_virtualArena.Clear();
+	g_virtualSnapshot.store(std::make_shared<const VirtualSnapshot>(), std::memory_order_release);
+
+	std::scoped_lock lockOverlay {g_overlayMutex};
+	for(auto &[path, reserved] : g_overlayFiles)
+		g_overlayUsage -= reserved;
+	g_overlayFiles.clear();
+}
+
+bool pragma::filesystem::FileManager::RemoveVirtualFileUnlocked(std::string path, std::shared_ptr<const VirtualSnapshot> &snapshot)
+{
+	// Virtual files are added with lower-case paths, and directory lookups are case-sensitive
+	string::to_lower(path);
+	std::string_view name = path;
+	VDirectory *dir = &m_vroot;
+	auto br = name.find_last_of("/\\");
+	if(br != std::string_view::npos) {
+		dir = dir->GetDirectory(name.substr(0, br));
+		name = name.substr(br + 1);
+	}
+	if(!dir)
+		return false;
+	auto *f = dir->GetFile(name);
+	if(!f)
+		return false;
+	dir->Remove(f);
+	// A file with the same name may have been shadowed by the removed one
+	auto *shadowed = dir->GetFile(name);
+	if(auto newSnapshot = snapshot->SetFile(path, shadowed ? shadowed->GetStorage() : nullptr))
+		snapshot = std::move(newSnapshot);
+	return true;
+}
+
+// Key used for the writable virtual overlay
+static std::string get_overlay_path(std::string path)
+{
+	path = pragma::filesystem::FileManager::GetCanonicalizedPath(path);
+	std::replace(path.begin(), path.end(), '\\', '/');
+	while(!path.empty() && path.back() == '/')
+		path.pop_back();
+	return path;
+}
+
+bool pragma::filesystem::FileManager::RemoveVirtualFile(std::string path)
+{
+	path = get_overlay_path(path);
+	std::scoped_lock lock {g_virtualMutex};
+	auto snapshot = load_virtual_snapshot();
+	if(!RemoveVirtualFileUnlocked(path, snapshot))
+		return false;
+	g_virtualSnapshot.store(std::move(snapshot), std::memory_order_release);
+	std::scoped_lock lockOverlay {g_overlayMutex};
+	auto it = g_overlayFiles.find(path);
+	if(it != g_overlayFiles.end()) {
+		g_overlayUsage -= it->second;
+		g_overlayFiles.erase(it);
+	}
+	return true;
+}
+
+void pragma::filesystem::FileManager::AddWritableVirtualPath(std::string path)
+{
+	path = get_overlay_path(path);
+	std::scoped_lock lock {g_overlayMutex};
+	auto &paths = *g_overlayPaths.load(std::memory_order_relaxed);
+	auto it = std::find_if(paths.begin(), paths.end(), [&path](const std::string &other) { return detail::CaseInsensitiveEqual {}(path, other); });
+	if(it != paths.end())
+		return;
+	auto newPaths = std::make_shared<std::vector<std::string>>(paths);
+	newPaths->push_back(path);
+	g_overlayPaths.store(std::move(newPaths), std::memory_order_release);
+}
+
+void pragma::filesystem::FileManager::RemoveWritableVirtualPath(std::string path)
+{
+	path = get_overlay_path(path);
+	std::scoped_lock lock {g_overlayMutex};
+	auto &paths = *g_overlayPaths.load(std::memory_order_relaxed);
+	auto it = std::find_if(paths.begin(), paths.end(), [&path](const std::string &other) { return detail::CaseInsensitiveEqual {}(path, other); });
+	if(it == paths.end())
+		return;
+	auto newPaths = std::make_shared<std::vector<std::string>>(paths);
+	newPaths->erase(newPaths->begin() + (it - paths.begin()));
+	g_overlayPaths.store(std::move(newPaths), std::memory_order_release);
+}
+
+static bool is_sub_path(const std::string_view &path, const std::string_view &parent)
+{
+	if(parent.empty())
+		return true;
+	if(path.length() < parent.length() || !pragma::filesystem::detail::CaseInsensitiveEqual {}(path.substr(0, parent.length()), parent))
+		return false;
+	return path.length() == parent.length() || path[parent.length()] == '/';
+}
+
+bool pragma::filesystem::FileManager::IsWritableVirtualPath(std::string path)
+{
+	path = get_overlay_path(path);
+	auto paths = g_overlayPaths.load(std::memory_order_acquire);
+	for(auto &parent : *paths) {
+		if(is_sub_path(path, parent))
+			return true;
+	}
+	return false;
+}
+
+void pragma::filesystem::FileManager::SetWritableVirtualMemoryBudget(uint64_t budget) { g_overlayBudget = budget; }
+uint64_t pragma::filesystem::FileManager::GetWritableVirtualMemoryUsage() { return g_overlayUsage; }
+
+static bool reserve_overlay_memory(uint64_t size)
+{
+	auto budget = g_overlayBudget.load();
+	auto usage = g_overlayUsage.load();
+	do {
+		if(budget > 0 && usage + size > budget)
+			return false;
+	} while(!g_overlayUsage.compare_exchange_weak(usage, usage + size));
+	return true;
+}
+
+pragma::filesystem::VFilePtr pragma::filesystem::FileManager::OpenWritableVirtualFile(const std::string &cpath, const char *mode)
+{
+	auto path = get_overlay_path(cpath);
+	std::string_view smode = mode;
+	auto append = smode.find_first_of("aA") != std::string_view::npos;
+	auto truncate = smode.find_first_of("wW") != std::string_view::npos;
+	auto data = std::make_shared<std::vector<uint8_t>>();
+	auto exists = false;
+	if(!truncate) {
+		// Append and update modes keep the existing contents. They're charged to the budget on the first write.
+		auto snapshot = GetVirtualSnapshot();
+		auto *entry = snapshot->Find(path);
+		if(entry && entry->file) {
+			auto mapping = entry->storage->Map();
+			data->assign(mapping.data.begin(), mapping.data.end());
+			exists = true;
+		}
+		else if(!append)
+			return nullptr;
+	}
+	auto pfile = std::make_shared<VFilePtrInternalMemory>(path, data, 0, append);
+	pfile->m_bRead = false;
+	if(!exists) {
+		// Same as with fopen, the file exists as soon as it has been opened
+		pfile->m_dirty = true;
+		pfile->Flush();
+	}
+	return pfile;
+}
+
+void pragma::filesystem::FileManager::CommitWritableVirtualFile(const std::string &path, const std::shared_ptr<std::vector<uint8_t>> &data, uint64_t &reserved)
+{
+	std::scoped_lock lock {g_virtualMutex};
+	{
+		// The reservation is handed over from the handle to the committed file
+		std::scoped_lock lockOverlay {g_overlayMutex};
+		auto it = g_overlayFiles.find(path);
+		if(it != g_overlayFiles.end()) {
+			g_overlayUsage -= it->second;
+			it->second = reserved;
+		}
+		else
+			g_overlayFiles.emplace(path, reserved);
+		reserved = 0;
+	}
+	auto snapshot = load_virtual_snapshot();
+	auto storage = std::make_shared<VFileVectorStorage>(data);
+	auto vpath = path;
+	string::to_lower(vpath);
+	auto *f = m_vroot.GetFile(vpath);
+	if(f) {
+		// Existing files are updated in place
+		f->m_storage = storage;
+		if(auto newSnapshot = snapshot->SetFile(vpath, storage))
+			snapshot = std::move(newSnapshot);
+	}
+	else
+		AddVirtualFileUnlocked(path, storage, snapshot);
+	g_virtualSnapshot.store(std::move(snapshot), std::memory_order_release);
+}
+
+uint32_t pragma::filesystem::FileManager::FlushWritableVirtualFiles(std::string path, bool release)
+{
+	path = get_overlay_path(path);
+	std::vector<std::string> files;
+	{
+		std::scoped_lock lock {g_overlayMutex};
+		for(auto &[filePath, reserved] : g_overlayFiles) {
+			if(is_sub_path(filePath, path))
+				files.push_back(filePath);
+		}
+	}
+	auto snapshot = GetVirtualSnapshot();
+	auto writePath = get_program_write_path();
+	std::vector<std::pair<std::string, const VirtualSnapshot::Entry *>> flushed;
+	for(auto &filePath : files) {
+		auto *entry = snapshot->Find(filePath);
+		if(!entry || !entry->file)
+			continue;
+		auto br = filePath.rfind('/');
+		if(br != std::string::npos)
+			CreateSystemPath(writePath, filePath.substr(0, br).c_str());
+		auto f = OpenSystemFile(util::FilePath(writePath, filePath).GetString().c_str(), "wb");
+		if(!f)
+			continue;
+		auto mapping = entry->storage->Map();
+		if(!mapping.data.empty())
+			f->Write(mapping.data.data(), mapping.data.size());
+		flushed.push_back({filePath, entry});
+	}
+	if(release) {
+		std::scoped_lock lock {g_virtualMutex};
+		auto current = load_virtual_snapshot();
+		for(auto &[filePath, entry] : flushed) {
+			// Don't discard contents that have been committed after the flush
+			auto *currentEntry = current->Find(filePath);
+			if(!currentEntry || !currentEntry->file || currentEntry->storage != entry->storage)
+				continue;
+			RemoveVirtualFileUnlocked(filePath, current);
+			std::scoped_lock lockOverlay {g_overlayMutex};
+			auto it = g_overlayFiles.find(filePath);
+			if(it != g_overlayFiles.end()) {
+				g_overlayUsage -= it->second;
+				g_overlayFiles.erase(it);
+			}
+		}
+		g_virtualSnapshot.store(std::move(current), std::memory_order_release);
+	}
+	return static_cast<uint32_t>(flushed.size());
+}
+
+void pragma::filesystem::FileManager::PublishVirtualSnapshot() { g_virtualSnapshot.store(VirtualSnapshot::Build(m_vroot), std::memory_order_release); }
+
+std::shared_ptr<const pragma::filesystem::VirtualSnapshot> pragma::filesystem::FileManager::GetVirtualSnapshot() { return load_virtual_snapshot(); }
+
+void pragma::filesystem::FileManager::ModifyVirtualFiles(const std::function<void(VDirectory &)> &f)
+{
+	std::scoped_lock lock {g_virtualMutex};
+	f(m_vroot);
+	PublishVirtualSnapshot();
+}
+
+void pragma::filesystem::VirtualFileBatch::Add(std::string path, const std::shared_ptr<std::vector<uint8_t>> &data) { Add(std::move(path), std::make_shared<VFileVectorStorage>(data)); }
+void pragma::filesystem::VirtualFileBatch::Add(std::string path, const std::shared_ptr<const VFileStorage> &storage) { m_files.push_back({std::move(path), storage}); }
+void pragma::filesystem::VirtualFileBatch::Commit()
+{
+	if(m_files.empty())
+		return;
+	std::scoped_lock lock {g_virtualMutex};
+	auto snapshot = load_virtual_snapshot();
+	FileManager::AddVirtualFilesUnlocked(m_files, snapshot);
+	m_files.clear();
+	g_virtualSnapshot.store(std::move(snapshot), std::memory_order_release);
+}
+
 pragma::filesystem::VDirectory *pragma::filesystem::FileManager::GetRootDirectory() { return &m_vroot; }
 std::string pragma::filesystem::FileManager::GetRootPath()
 {
@@ -326,7 +784,7 @@ pragma::filesystem::VFilePtr pragma::filesystem::FileManager::OpenPackageFile(co
 	bool bWrite = IsWriteMode(mode);
 	if(bWrite == true)
 		return nullptr;
-	std::unique_lock lock {g_packageMutex};
+	std::shared_lock lock {g_packageMutex};
 	auto it = m_packages.find(packageName);
 	if(it == m_packages.end())
 		return nullptr;
@@ -335,7 +793,7 @@ pragma::filesystem::VFilePtr pragma::filesystem::FileManager::OpenPackageFile(co
 
 pragma::filesystem::PackageManager *pragma::filesystem::FileManager::GetPackageManager(const std::string &name)
 {
-	std::unique_lock lock {g_packageMutex};
+	std::shared_lock lock {g_packageMutex};
 	auto it = m_packages.find(name);
 	if(it == m_packages.end())
 		return nullptr;
@@ -353,7 +811,13 @@ pragma::filesystem::VFilePtr pragma::filesystem::FileManager::OpenFile(const cha
 	VFilePtr pfile;
 	bool bBinary = IsBinaryMode(mode);
 	bool bWrite = IsWriteMode(mode);
-	if(bWrite) // Can't write virtual or packed file, so it must be on hardspace
+	if(bWrite && (includeFlags & SearchFlags::Virtual) == SearchFlags::Virtual && IsWritableVirtualPath(path)) {
+		pfile = OpenWritableVirtualFile(path, mode);
+		if(pfile != nullptr)
+			pfile->m_bBinary = bBinary;
+		return pfile;
+	}
+	if(bWrite) // Can't write packed file, so it must be on hardspace
 	{
 		if((includeFlags & SearchFlags::Local) == SearchFlags::None)
 			return NULL;
@@ -372,21 +836,26 @@ pragma::filesystem::VFilePtr pragma::filesystem::FileManager::OpenFile(const cha
 	pragma::string::to_lower(path);
 #endif
 	if((includeFlags & SearchFlags::Virtual) == SearchFlags::Virtual) {
-		VFile *f = m_vroot.GetFile(path);
-		if(f != NULL) {
-			auto pfile = std::make_shared<VFilePtrInternalVirtual>(f);
+		auto snapshot = GetVirtualSnapshot();
+		auto *entry = snapshot->Find(path);
+		if(entry != nullptr && entry->file) {
+			auto pfile = std::make_shared<VFilePtrInternalVirtual>(entry->storage);
 			pfile->m_bBinary = bBinary;
 			pfile->m_bRead = true;
 			return pfile;
 		}
 	}
 	if((includeFlags & SearchFlags::Package) == SearchFlags::Package) {
-		std::unique_lock lock {g_packageMutex};
-		for(auto &pair : m_packages) {
-			pfile = pair.second->OpenFile(path, bBinary, includeFlags, excludeFlags);
-			if(pfile != nullptr)
-				return pfile;
-		}
+		std::shared_lock lock {g_packageMutex};
+		auto index = get_package_index();
+		auto found = index->Visit(path, includeFlags, [&](const PackageManager &manager, const PackageIndex::Entry *entry) {
+			if(entry && math::is_flag_set(entry->flags, FVFile::Directory))
+				return false;
+			pfile = manager.OpenFile(path, bBinary, includeFlags, excludeFlags);
+			return pfile != nullptr;
+		});
+		if(found)
+			return pfile;
 	}
 	if((includeFlags & SearchFlags::Local) == SearchFlags::None)
 		return NULL;
@@ -429,10 +898,12 @@ pragma::filesystem::VFilePtr pragma::filesystem::FileManager::OpenFile(const cha
 pragma::filesystem::Package *pragma::filesystem::FileManager::LoadPackage(std::string package, SearchFlags searchMode)
 {
 	std::unique_lock lock {g_packageMutex};
-	for(auto &pair : m_packages) {
-		auto *pck = pair.second->LoadPackage(package, searchMode);
-		if(pck != nullptr)
+	for(auto *manager : g_packageManagers) {
+		auto *pck = manager->LoadPackage(package, searchMode);
+		if(pck != nullptr) {
+			invalidate_package_index();
 			return pck;
+		}
 	}
 	return nullptr;
 }
@@ -440,14 +911,19 @@ pragma::filesystem::Package *pragma::filesystem::FileManager::LoadPackage(std::s
 void pragma::filesystem::FileManager::ClearPackages(SearchFlags searchMode)
 {
 	std::unique_lock lock {g_packageMutex};
-	for(auto &pair : m_packages)
-		pair.second->ClearPackages(searchMode);
+	for(auto *manager : g_packageManagers)
+		manager->ClearPackages(searchMode);
+	invalidate_package_index();
 }
 
 void pragma::filesystem::FileManager::RegisterPackageManager(const std::string &name, std::unique_ptr<PackageManager> pm)
 {
 	std::unique_lock lock {g_packageMutex};
-	m_packages.insert(std::make_pair(name, std::move(pm)));
+	auto *ptr = pm.get();
+	if(!m_packages.insert(std::make_pair(name, std::move(pm))).second)
+		return;
+	g_packageManagers.push_back(ptr);
+	invalidate_package_index();
 }
 
 bool pragma::filesystem::FileManager::RemoveSystemFile(const char *file)
@@ -643,66 +1119,80 @@ bool pragma::filesystem::FileManager::FindLocalPath(std::string path, std::strin
 	return false;
 }
 
-static void find_files(const std::string &path, const std::string &ctarget, const std::string &localMountPath, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, bool bKeepPath, size_t szFiles = 0, size_t szDirs = 0)
+// Calls f(name, isDirectory, isSymbolicLink, size) for every entry of the directory that matches the pattern, until f returns false.
+// The size is only retrieved for files, and only if includeSize is true. Returns false if f stopped the enumeration.
+template<typename F>
+static bool visit_directory(const std::string &path, const pragma::filesystem::Glob &glob, bool includeSize, const F &f)
 {
-	auto numFilesSpecial = (resfiles != nullptr) ? (resfiles->size() - szFiles) : 0;
-	auto numDirsSpecial = (resdirs != nullptr) ? (resdirs->size() - szDirs) : 0;
 #ifdef __linux__
 	std::string __path = path;
 	std::replace(__path.begin(), __path.end(), '\\', '/');
-	DIR *dir = opendir(__path.c_str());
-	if(dir != nullptr) {
-		class stat st;
-		dirent *ent;
-		while((ent = readdir(dir)) != nullptr) {
-			std::string fileName = ent->d_name;
-			const std::string fullFileName = __path + fileName;
-			if(stat(fullFileName.c_str(), &st) != -1) {
-				const bool isDir = (st.st_mode & S_IFDIR) != 0;
-				if(resfiles != nullptr && isDir == false) {
-					if(pragma::string::match(fileName.c_str(), ctarget, false)) {
-						auto pathName = bKeepPath == false ? fileName : (localMountPath + fileName);
-						if(!pragma::filesystem::impl::has_value(resfiles, szFiles, szFiles + numFilesSpecial, fileName, true))
-							resfiles->push_back(pathName);
-					}
-				}
-				if(resdirs != nullptr && isDir == true) {
-					if(fileName != "." && fileName != ".." && pragma::string::match(fileName.c_str(), ctarget, false)) {
-						auto pathName = bKeepPath == false ? fileName : (localMountPath + fileName);
-						if(!pragma::filesystem::impl::has_value(resdirs, szDirs, szDirs + numDirsSpecial, fileName, true))
-							resdirs->push_back(pathName);
-					}
-				}
-			}
+	auto fd = open(__path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd == -1)
+		return true;
+	// The directory takes ownership of the file descriptor
+	DIR *dir = fdopendir(fd);
+	if(dir == nullptr) {
+		close(fd);
+		return true;
+	}
+	dirent *ent;
+	while((ent = readdir(dir)) != nullptr) {
+		const char *fileName = ent->d_name;
+		struct stat st;
+		auto hasStat = false;
+		auto isLink = false;
+		bool isDir;
+		switch(ent->d_type) {
+		case DT_DIR:
+			isDir = true;
+			break;
+		case DT_REG:
+			isDir = false;
+			break;
+		default:
+			// Symbolic links are resolved and some file systems don't report the type, so those need a stat
+			if(ent->d_type == DT_LNK)
+				isLink = true;
+			else if(ent->d_type == DT_UNKNOWN && fstatat(dirfd(dir), fileName, &st, AT_SYMLINK_NOFOLLOW) != -1)
+				isLink = S_ISLNK(st.st_mode);
+			if(fstatat(dirfd(dir), fileName, &st, 0) == -1)
+				continue;
+			hasStat = true;
+			isDir = S_ISDIR(st.st_mode);
+			break;
+		}
+		if(isDir && (std::strcmp(fileName, ".") == 0 || std::strcmp(fileName, "..") == 0))
+			continue;
+		if(!glob.Match(fileName))
+			continue;
+		std::optional<uint64_t> size {};
+		if(includeSize && !isDir && (hasStat || fstatat(dirfd(dir), fileName, &st, 0) != -1))
+			size = st.st_size;
+		if(!f(std::string_view {fileName}, isDir, isLink, size)) {
+			closedir(dir);
+			return false;
 		}
-		closedir(dir);
 	}
+	closedir(dir);
 #else
 	auto searchPath = path + '*';
 	auto wsearchPath = string_to_wstring(searchPath);
 	if(!wsearchPath)
-		return;
+		return true;
 	WIN32_FIND_DATAW data;
 	HANDLE hFind = FindFirstFileW(wsearchPath->c_str(), &data);
 	while(hFind != INVALID_HANDLE_VALUE) {
-		if(resfiles != NULL) {
-			if((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
-				auto fileName = pragma::string::wstring_to_string(data.cFileName);
-				if(pragma::string::match(fileName, ctarget, false)) {
-					auto pathName = bKeepPath == false ? fileName : (localMountPath + fileName);
-					if(!pragma::filesystem::impl::has_value(resfiles, szFiles, szFiles + numFilesSpecial, fileName))
-						resfiles->push_back(pathName);
-				}
-			}
-		}
-		if(resdirs != NULL) {
-			if((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY) {
-				std::string fileName = pragma::string::wstring_to_string(data.cFileName);
-				if(fileName != "." && fileName != ".." && pragma::string::match(fileName, ctarget, false)) {
-					auto pathName = bKeepPath == false ? fileName : (localMountPath + fileName);
-					if(!pragma::filesystem::impl::has_value(resdirs, szDirs, szDirs + numDirsSpecial, fileName))
-						resdirs->push_back(pathName);
-				}
+		auto isDir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY;
+		auto isLink = (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == FILE_ATTRIBUTE_REPARSE_POINT;
+		auto fileName = pragma::string::wstring_to_string(data.cFileName);
+		if((!isDir || (fileName != "." && fileName != "..")) && glob.Match(fileName)) {
+			std::optional<uint64_t> size {};
+			if(includeSize && !isDir)
+				size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+			if(!f(std::string_view {fileName}, isDir, isLink, size)) {
+				FindClose(hFind);
+				return false;
 			}
 		}
 		if(!FindNextFileW(hFind, &data)) {
@@ -711,6 +1201,18 @@ static void find_files(const std::string &path, const std::string &ctarget, cons
 		}
 	}
 #endif
+	return true;
+}
+
+// Duplicates are not filtered, see impl::FindResultFilter
+static void find_files(const std::string &path, const pragma::filesystem::Glob &glob, const std::string &localMountPath, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, bool bKeepPath)
+{
+	visit_directory(path, glob, false, [&](const std::string_view &name, bool isDir, bool, std::optional<uint64_t>) {
+		auto *results = isDir ? resdirs : resfiles;
+		if(results != nullptr)
+			results->push_back(bKeepPath == false ? std::string {name} : (localMountPath + std::string {name}));
+		return true;
+	});
 }
 
 void pragma::filesystem::FileManager::FindFiles(const char *cfind, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, SearchFlags includeFlags, SearchFlags excludeFlags) { FindFiles(cfind, resfiles, resdirs, false, includeFlags, excludeFlags); }
@@ -737,39 +1239,44 @@ void pragma::filesystem::FileManager::FindFiles(const char *cfind, std::vector<s
 	std::string target;
 	size_t lbr;
 	get_find_string(cfind, path, target, lbr);
-
-	auto szFiles = (resfiles != nullptr) ? resfiles->size() : 0;
-	auto szDirs = (resdirs != nullptr) ? resdirs->size() : 0;
+	auto glob = Glob::Compile(target, false, Glob::Syntax::Wildcards);
+
+	// Every source is only compared against the results of the previous sources, using hash sets
+	impl::FindResultFilter fileFilter {resfiles, (resfiles != nullptr) ? resfiles->size() : 0};
+	impl::FindResultFilter dirFilter {resdirs, (resdirs != nullptr) ? resdirs->size() : 0};
+	auto commit = [&fileFilter, &dirFilter](bool bKeepCase) {
+		fileFilter.Commit(bKeepCase);
+		dirFilter.Commit(bKeepCase);
+	};
 	if((includeFlags & SearchFlags::Virtual) == SearchFlags::Virtual) {
-		VDirectory *dir = &m_vroot;
-		if(lbr != string::NOT_FOUND)
-			dir = dir->GetDirectory(path);
+		auto snapshot = GetVirtualSnapshot();
+		auto *dir = &snapshot->GetRoot();
+		if(lbr != string::NOT_FOUND) {
+			dir = snapshot->Find(path);
+			if(dir != nullptr && !dir->directory)
+				dir = nullptr;
+		}
 		if(dir != NULL) {
-			std::vector<VData *> &files = dir->GetFiles();
-			for(unsigned int i = 0; i < files.size(); i++) {
-				VData *data = files[i];
-				std::string name = data->GetName();
-				if(data->IsFile()) {
-					if(resfiles != NULL && string::match(name.c_str(), target, false)) {
-						auto pathName = bKeepPath == false ? name : (path + name);
-						if(!impl::has_value(resfiles, 0, resfiles->size(), name))
-							resfiles->push_back(pathName);
-					}
+			for(auto &child : dir->children) {
+				std::string name {child.name};
+				if(child.entry->file) {
+					if(resfiles != NULL && glob.Match(name))
+						resfiles->push_back(bKeepPath == false ? name : (path + name));
 				}
-				else {
-					if(resdirs != NULL && string::match(name.c_str(), target, false)) {
-						auto pathName = bKeepPath == false ? name : (path + name);
-						if(!impl::has_value(resdirs, 0, resdirs->size(), name))
-							resdirs->push_back(pathName);
-					}
+				if(child.entry->directory) {
+					if(resdirs != NULL && glob.Match(name))
+						resdirs->push_back(bKeepPath == false ? name : (path + name));
 				}
 			}
 		}
+		commit(false);
 	}
 	if((includeFlags & SearchFlags::Package) == SearchFlags::Package) {
-		std::unique_lock lock {g_packageMutex};
-		for(auto &pair : m_packages)
-			pair.second->FindFiles(cfind, path, resfiles, resdirs, bKeepPath, includeFlags);
+		std::shared_lock lock {g_packageMutex};
+		for(auto *manager : g_packageManagers) {
+			manager->FindFiles(cfind, path, resfiles, resdirs, bKeepPath, includeFlags);
+			commit(false);
+		}
 	}
 	if((includeFlags & SearchFlags::Local) == SearchFlags::None)
 		return;
@@ -786,9 +1293,83 @@ void pragma::filesystem::FileManager::FindFiles(const char *cfind, std::vector<s
 				path = appPath + DIR_SEPARATOR + localMountPath;
 			else
 				path = localMountPath;
-			::find_files(path, target, localMountPath, resfiles, resdirs, bKeepPath, szFiles, szDirs);
+			::find_files(path, glob, localMountPath, resfiles, resdirs, bKeepPath);
+			commit(LOCAL_PATHS_CASE_SENSITIVE);
+		}
+	}
+}
+
+bool pragma::filesystem::FileManager::VisitFiles(const char *cfind, const DirectoryVisitor &visitor, bool includeSize, SearchFlags includeFlags, SearchFlags excludeFlags)
+{
+	std::string path;
+	std::string target;
+	size_t lbr;
+	get_find_string(cfind, path, target, lbr);
+	auto glob = Glob::Compile(target, false, Glob::Syntax::Wildcards);
+
+	// Files and directories that have already been reported are skipped
+	std::array<impl::DuplicateFilter, 2> filters;
+	auto visit = [&filters, &visitor](const std::string_view &name, bool directory, FileLayer layer, bool symbolicLink, std::optional<uint64_t> size, bool bKeepCase) {
+		if(!filters[directory ? 1 : 0].Add(name, bKeepCase))
+			return true;
+		return visitor({name, layer, directory, symbolicLink, size});
+	};
+	if((includeFlags & SearchFlags::Virtual) == SearchFlags::Virtual) {
+		auto snapshot = GetVirtualSnapshot();
+		auto *dir = &snapshot->GetRoot();
+		if(lbr != string::NOT_FOUND) {
+			dir = snapshot->Find(path);
+			if(dir != nullptr && !dir->directory)
+				dir = nullptr;
+		}
+		if(dir != nullptr) {
+			for(auto &child : dir->children) {
+				std::string_view name {child.name};
+				if(!glob.Match(name))
+					continue;
+				if(child.entry->file) {
+					std::optional<uint64_t> size {};
+					if(includeSize)
+						size = child.entry->storage->GetSize();
+					if(!visit(name, false, FileLayer::Virtual, false, size, false))
+						return false;
+				}
+				if(child.entry->directory && !visit(name, true, FileLayer::Virtual, false, {}, false))
+					return false;
+			}
+		}
+	}
+	if((includeFlags & SearchFlags::Package) == SearchFlags::Package) {
+		std::shared_lock lock {g_packageMutex};
+		for(auto *manager : g_packageManagers) {
+			auto completed = manager->VisitFiles(cfind, path, [&visit](const DirectoryEntry &entry) { return visit(entry.name, entry.directory, entry.layer, entry.symbolicLink, entry.size, false); }, includeSize, includeFlags);
+			if(!completed)
+				return false;
+		}
+	}
+	if((includeFlags & SearchFlags::Local) == SearchFlags::None)
+		return true;
+	std::string localPath = path;
+	std::shared_lock lock {g_customMountMutex};
+	for(auto &rootPath : get_absolute_root_paths()) {
+		auto appPath = rootPath.GetString();
+		MountIterator it(m_customMount);
+		std::string mountPath;
+		bool bAbsolute = false;
+		while(it.GetNextDirectory(mountPath, includeFlags, excludeFlags, bAbsolute)) {
+			// The root directory itself is always the last one returned by the mount iterator
+			auto layer = (mountPath == ".") ? FileLayer::Root : FileLayer::Mount;
+			std::string localMountPath = mountPath + DIR_SEPARATOR + localPath;
+			if(bAbsolute == false)
+				path = appPath + DIR_SEPARATOR + localMountPath;
+			else
+				path = localMountPath;
+			auto completed = ::visit_directory(path, glob, includeSize, [&visit, layer](const std::string_view &name, bool isDir, bool isLink, std::optional<uint64_t> size) { return visit(name, isDir, layer, isLink, size, LOCAL_PATHS_CASE_SENSITIVE); });
+			if(!completed)
+				return false;
 		}
 	}
+	return true;
 }
 
 char pragma::filesystem::FileManager::GetDirectorySeparator() { return DIR_SEPARATOR; }
@@ -799,7 +1380,14 @@ void pragma::filesystem::FileManager::FindSystemFiles(const char *path, std::vec
 	std::string target;
 	size_t lbr;
 	get_find_string(path, npath, target, lbr);
-	::find_files(npath, target, "", resfiles, resdirs, bKeepPath);
+	// Entries that were already in the result lists are not added again, but are left untouched
+	impl::FindResultFilter fileFilter {resfiles, (resfiles != nullptr) ? resfiles->size() : 0};
+	impl::FindResultFilter dirFilter {resdirs, (resdirs != nullptr) ? resdirs->size() : 0};
+	fileFilter.ExcludeExisting(LOCAL_PATHS_CASE_SENSITIVE);
+	dirFilter.ExcludeExisting(LOCAL_PATHS_CASE_SENSITIVE);
+	::find_files(npath, Glob::Compile(target, false, Glob::Syntax::Wildcards), "", resfiles, resdirs, bKeepPath);
+	fileFilter.Commit(LOCAL_PATHS_CASE_SENSITIVE);
+	dirFilter.Commit(LOCAL_PATHS_CASE_SENSITIVE);
 }
 
 std::string pragma::filesystem::FileManager::GetCanonicalizedPath(std::string path)
@@ -896,6 +1484,9 @@ bool pragma::filesystem::FileManager::CreateDirectory(const char *dir)
 void pragma::filesystem::FileManager::Close()
 {
 	std::unique_lock lock {g_packageMutex};
+	g_packageManagers.clear();
+	invalidate_package_index();
+	g_packageIndex.store(nullptr);
 	m_packages.clear();
 }
 
@@ -941,72 +1532,25 @@ void pragma::filesystem::FileManager::WriteString(FILE *f, std::string str, bool
 
 std::optional<std::filesystem::file_time_type> pragma::filesystem::FileManager::GetLastWriteTime(const std::string_view &path, SearchFlags includeFlags, SearchFlags excludeFlags)
 {
-	std::string rpath;
-	if(!FindLocalPath(std::string {path}, rpath, includeFlags, excludeFlags))
-		return {};
-	try {
-		auto ftime = std::filesystem::last_write_time(rpath);
-		return ftime;
-	}
-	catch(std::filesystem::filesystem_error &e) {
-		return {};
-	}
-	return {};
-}
-
-std::uint64_t pragma::filesystem::FileManager::GetFileSize(std::string name, SearchFlags fsearchmode)
-{
-	NormalizePath(name);
-	if((fsearchmode & SearchFlags::Virtual) == SearchFlags::Virtual) {
-		VData *vdata = GetVirtualData(name);
-		if(vdata != NULL) {
-			if(vdata->IsDirectory())
-				return 0;
-			VFile *file = static_cast<VFile *>(vdata);
-			return file->GetSize();
-		}
-	}
-	if((fsearchmode & SearchFlags::Package) == SearchFlags::Package) {
-		std::unique_lock lock {g_packageMutex};
-		uint64_t size = 0;
-		for(auto &pair : m_packages) {
-			if(pair.second->GetSize(name, size) == true)
-				return size;
-		}
-	}
-	if((fsearchmode & SearchFlags::Local) == SearchFlags::None)
-		return 0;
-	auto f = OpenFile(name.c_str(), "rb", nullptr, fsearchmode);
-	if(f == NULL)
-		return 0;
-	return f->GetSize();
+	// Only local files have a write time
+	return GetFileInfo(std::string {path}, includeFlags & ~(SearchFlags::Virtual | SearchFlags::Package), excludeFlags).lastWriteTime;
 }
 
-pragma::filesystem::VData *pragma::filesystem::FileManager::GetVirtualData(std::string path)
-{
-	NormalizePath(path);
-	VFile *f = m_vroot.GetFile(path);
-	if(f != NULL)
-		return f;
-	VDirectory *dir = m_vroot.GetDirectory(path);
-	if(dir != NULL)
-		return dir;
-	return NULL;
-}
+std::uint64_t pragma::filesystem::FileManager::GetFileSize(std::string name, SearchFlags fsearchmode) { return GetFileInfo(std::move(name), fsearchmode).size; }
 
 bool pragma::filesystem::FileManager::Exists(std::string name, SearchFlags includeFlags, SearchFlags excludeFlags)
 {
 	NormalizePath(name);
 	if(name.empty())
 		return false;
-	if((includeFlags & SearchFlags::Virtual) == SearchFlags::Virtual && GetVirtualData(name) != NULL)
+	if((includeFlags & SearchFlags::Virtual) == SearchFlags::Virtual && GetVirtualSnapshot()->Find(name) != nullptr)
 		return true;
 	if((includeFlags & SearchFlags::Package) == SearchFlags::Package) {
-		std::unique_lock lock {g_packageMutex};
-		for(auto &pair : m_packages) {
-			if(pair.second->Exists(name, includeFlags) == true)
-				return true;
-		}
+		std::shared_lock lock {g_packageMutex};
+		auto index = get_package_index();
+		auto found = index->Visit(name, includeFlags, [&](const PackageManager &manager, const PackageIndex::Entry *entry) { return entry != nullptr || manager.Exists(name, includeFlags); });
+		if(found)
+			return true;
 	}
 	if((includeFlags & SearchFlags::Local) == SearchFlags::None)
 		return false;
@@ -1029,6 +1573,134 @@ bool pragma::filesystem::FileManager::Exists(std::string name, SearchFlags inclu
 	return false;
 }
 
+#ifdef _WIN32
+static unsigned long long get_file_attributes(const std::string &fpath);
+#endif
+
+std::optional<std::string> pragma::filesystem::FileManager::FindAvailableFile(const std::string &baseName, const std::vector<std::string_view> &extensions, SearchFlags includeFlags, SearchFlags excludeFlags)
+{
+	auto name = baseName;
+	NormalizePath(name);
+	if(name.empty())
+		return {};
+	std::vector<std::string> candidates;
+	candidates.reserve(extensions.size() + 1);
+	candidates.push_back(name);
+	for(auto &ext : extensions) {
+		auto candidate = name;
+		candidate += '.';
+		candidate += ext;
+		candidates.push_back(std::move(candidate));
+	}
+	// Index of the best candidate so far; Every layer only has to look for candidates with a higher priority
+	auto best = candidates.size();
+	auto getResult = [&]() -> std::optional<std::string> {
+		if(best == candidates.size())
+			return {};
+		if(best == 0)
+			return baseName;
+		return baseName + '.' + std::string {extensions[best - 1]};
+	};
+	if((includeFlags & SearchFlags::Virtual) == SearchFlags::Virtual) {
+		auto snapshot = GetVirtualSnapshot();
+		for(size_t i = 0; i < best; ++i) {
+			if(snapshot->Find(candidates[i]) != nullptr) {
+				best = i;
+				break;
+			}
+		}
+		if(best == 0)
+			return getResult();
+	}
+	if((includeFlags & SearchFlags::Package) == SearchFlags::Package) {
+		std::shared_lock lock {g_packageMutex};
+		auto index = get_package_index();
+		for(size_t i = 0; i < best; ++i) {
+			auto &candidate = candidates[i];
+			auto found = index->Visit(candidate, includeFlags, [&](const PackageManager &manager, const PackageIndex::Entry *entry) { return entry != nullptr || manager.Exists(candidate, includeFlags); });
+			if(found) {
+				best = i;
+				break;
+			}
+		}
+		if(best == 0)
+			return getResult();
+	}
+	if((includeFlags & SearchFlags::Local) == SearchFlags::None)
+		return getResult();
+
+	auto *fic = get_root_path_file_cache_manager();
+	if(fic && fic->IsComplete()) {
+		for(size_t i = 0; i < best; ++i) {
+			if(fic->Exists(candidates[i])) {
+				best = i;
+				break;
+			}
+		}
+		return getResult();
+	}
+
+	// All candidates are in the same directory. Unless there are a lot of candidates, probing them is cheaper than listing the directory.
+	constexpr size_t MAX_PROBED_CANDIDATES = 16;
+	std::string localDir;
+	auto lbr = name.rfind(DIR_SEPARATOR);
+	if(lbr != std::string::npos)
+		localDir = DIR_SEPARATOR + name.substr(0, lbr);
+	auto fileNameOffset = (lbr != std::string::npos) ? (lbr + 1) : 0;
+	std::unordered_map<std::string_view, size_t, detail::CaseInsensitiveHash, detail::CaseInsensitiveEqual> candidateIndices;
+	if(candidates.size() > MAX_PROBED_CANDIDATES) {
+		for(size_t i = 0; i < candidates.size(); ++i)
+			candidateIndices.try_emplace(std::string_view {candidates[i]}.substr(fileNameOffset), i);
+	}
+	Glob glob {};
+	std::shared_lock lock {g_customMountMutex};
+	for(auto &rootPath : get_absolute_root_paths()) {
+		auto appPath = rootPath.GetString();
+		MountIterator it(m_customMount);
+		std::string mountPath;
+		bool bAbsolute = false;
+		while(best > 0 && it.GetNextDirectory(mountPath, includeFlags, excludeFlags, bAbsolute)) {
+			std::string path = mountPath + localDir;
+			if(bAbsolute == false)
+				path = appPath + DIR_SEPARATOR + path;
+			// The filesystem is case-insensitive, but the operating system may not be
+			impl::to_case_sensitive_path(path);
+			path += DIR_SEPARATOR;
+			if(candidateIndices.empty()) {
+#ifdef __linux__
+				std::replace(path.begin(), path.end(), '\\', '/');
+				auto fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+				if(fd == -1)
+					continue;
+				for(size_t i = 0; i < best; ++i) {
+					struct stat st;
+					if(fstatat(fd, candidates[i].c_str() + fileNameOffset, &st, 0) == 0) {
+						best = i;
+						break;
+					}
+				}
+				::close(fd);
+#else
+				for(size_t i = 0; i < best; ++i) {
+					if(get_file_attributes(path + (candidates[i].c_str() + fileNameOffset)) != INVALID_FILE_ATTRIBUTES) {
+						best = i;
+						break;
+					}
+				}
+#endif
+				continue;
+			}
+			::visit_directory(path, glob, false, [&](const std::string_view &entryName, bool, bool, std::optional<uint64_t>) {
+				auto itCandidate = candidateIndices.find(entryName);
+				if(itCandidate != candidateIndices.end() && itCandidate->second < best)
+					best = itCandidate->second;
+				return best > 0;
+			});
+		}
+	}
+	return getResult();
+}
+
 #ifdef __linux__
 #define FILE_ATTRIBUTE_NORMAL 0x80
 #define FILE_ATTRIBUTE_DIRECTORY 0x10
@@ -1077,45 +1749,159 @@ std::uint64_t pragma::filesystem::FileManager::GetFileAttributes(std::string nam
 	return INVALID_FILE_ATTRIBUTES;
 }
 
-pragma::filesystem::FVFile pragma::filesystem::FileManager::GetFileFlags(std::string name, SearchFlags includeFlags, SearchFlags excludeFlags)
+pragma::filesystem::FVFile pragma::filesystem::FileManager::GetFileFlags(std::string name, SearchFlags includeFlags, SearchFlags excludeFlags) { return GetFileInfo(std::move(name), includeFlags, excludeFlags, false).flags; }
+
+bool pragma::filesystem::FileManager::IsFile(std::string name, SearchFlags fsearchmode)
 {
-	NormalizePath(name);
-	if((includeFlags & SearchFlags::Virtual) == SearchFlags::Virtual) {
-		VData *vdata = GetVirtualData(name);
-		if(vdata != NULL) {
-			auto flags = (FVFile::ReadOnly | FVFile::Virtual);
-			if(vdata->IsDirectory())
-				flags |= FVFile::Directory;
-			return flags;
-		}
+	auto flags = GetFileFlags(name, fsearchmode);
+	return (flags != FVFile::Invalid && (flags & FVFile::Directory) == FVFile::None) ? true : false;
+}
+
+bool pragma::filesystem::FileManager::IsDir(std::string name, SearchFlags fsearchmode) { return (GetFileFlags(name, fsearchmode) & FVFile::Directory) == FVFile::Directory; }
+
+// Retrieves the flags and optionally the size, permissions and last write time of a local file. Returns false if the file doesn't exist.
+static bool stat_local_file(const std::string &fpath, pragma::filesystem::FileInfo &outInfo, bool includeDetails)
+{
+#ifdef __linux__
+	// Only the requested fields are retrieved
+	unsigned int mask = includeDetails ? (STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME) : STATX_TYPE;
+	struct statx stx;
+	auto res = statx(AT_FDCWD, fpath.c_str(), AT_STATX_SYNC_AS_STAT, mask, &stx);
+	// statx may not be available (old kernels, seccomp filters) and file systems may not report all of the requested fields
+	if(res == -1 && errno != ENOSYS && errno != EPERM)
+		return false;
+	mode_t mode;
+	uint64_t size;
+	struct timespec mtime;
+	if(res == 0 && (stx.stx_mask & mask) == mask) {
+		mode = stx.stx_mode;
+		size = stx.stx_size;
+		mtime = {static_cast<time_t>(stx.stx_mtime.tv_sec), static_cast<long>(stx.stx_mtime.tv_nsec)};
 	}
-	if((includeFlags & SearchFlags::Package) == SearchFlags::Package) {
-		std::unique_lock lock {g_packageMutex};
-		FVFile flags = FVFile::None;
-		for(auto &pair : m_packages) {
-			if(pair.second->GetFileFlags(name, includeFlags, flags) == true)
-				return flags;
+	else {
+		struct stat st;
+		if(stat(fpath.c_str(), &st) == -1)
+			return false;
+		mode = st.st_mode;
+		size = st.st_size;
+		mtime = st.st_mtim;
+	}
+	auto isDir = S_ISDIR(mode);
+	outInfo.flags = isDir ? pragma::filesystem::FVFile::Directory : pragma::filesystem::FVFile::None;
+	if(!includeDetails)
+		return true;
+	if(!isDir)
+		outInfo.size = size;
+	outInfo.permissions = static_cast<std::filesystem::perms>(mode & 07777);
+	auto duration = std::chrono::seconds {mtime.tv_sec} + std::chrono::nanoseconds {mtime.tv_nsec};
+	outInfo.lastWriteTime = std::chrono::file_clock::from_sys(std::chrono::sys_time<std::chrono::nanoseconds> {duration});
+#else
+	auto wstr = string_to_wstring(fpath);
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if(!wstr || !GetFileAttributesExW(wstr->c_str(), GetFileExInfoStandard, &data))
+		return false;
+	auto isDir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY;
+	outInfo.flags = isDir ? pragma::filesystem::FVFile::Directory : pragma::filesystem::FVFile::None;
+	if(!includeDetails)
+		return true;
+	if(!isDir)
+		outInfo.size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+	// Same mapping as std::filesystem::status
+	outInfo.permissions = ((data.dwFileAttributes & FILE_ATTRIBUTE_READONLY) == FILE_ATTRIBUTE_READONLY) ? (std::filesystem::perms::all & ~(std::filesystem::perms::owner_write | std::filesystem::perms::group_write | std::filesystem::perms::others_write)) : std::filesystem::perms::all;
+	// The file clock uses the FILETIME epoch and resolution on Windows
+	auto ticks = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+	outInfo.lastWriteTime = std::filesystem::file_time_type {std::filesystem::file_time_type::duration {ticks}};
+#endif
+	return true;
+}
+
+// Tries the exact path first, since resolving the case requires listing every directory in the path
+static bool stat_local_file_any_case(std::string &path, pragma::filesystem::FileInfo &outInfo, bool includeDetails)
+{
+	if(stat_local_file(path, outInfo, includeDetails))
+		return true;
+	if(!LOCAL_PATHS_CASE_SENSITIVE)
+		return false;
+	pragma::filesystem::impl::to_case_sensitive_path(path);
+	return stat_local_file(path, outInfo, includeDetails);
+}
+
+static bool find_virtual_file_info(const pragma::filesystem::VirtualSnapshot &snapshot, const std::string &name, pragma::filesystem::FileInfo &outInfo)
+{
+	auto *entry = snapshot.Find(name);
+	if(entry == nullptr)
+		return false;
+	outInfo.layer = pragma::filesystem::FileLayer::Virtual;
+	outInfo.flags = pragma::filesystem::FVFile::Virtual;
+	if(!entry->file)
+		outInfo.flags |= pragma::filesystem::FVFile::Directory;
+	else
+		outInfo.size = entry->storage->GetSize();
+	if(!pragma::filesystem::FileManager::IsWritableVirtualPath(name))
+		outInfo.flags |= pragma::filesystem::FVFile::ReadOnly;
+	return true;
+}
+
+// Has to be called with g_packageMutex locked
+static bool find_package_file_info(const PackageIndex &index, const std::string &name, pragma::filesystem::SearchFlags includeFlags, bool includeDetails, pragma::filesystem::FileInfo &outInfo)
+{
+	auto flags = pragma::filesystem::FVFile::None;
+	uint64_t size = 0;
+	auto found = index.Visit(name, includeFlags, [&](const pragma::filesystem::PackageManager &manager, const PackageIndex::Entry *entry) {
+		if(entry) {
+			flags = entry->flags;
+			size = entry->size;
+			return true;
 		}
+		if(!manager.GetFileFlags(name, includeFlags, flags))
+			return false;
+		if(includeDetails)
+			manager.GetSize(name, size);
+		return true;
+	});
+	if(!found)
+		return false;
+	outInfo.layer = pragma::filesystem::FileLayer::Package;
+	outInfo.flags = flags;
+	outInfo.size = size;
+	return true;
+}
+
+// Shared by all GetFileInfos calls. Intentionally leaked, since files may still be queried during static destruction.
+static BS::light_thread_pool &get_stat_thread_pool()
+{
+	static auto *pool = new BS::light_thread_pool {std::max(std::thread::hardware_concurrency(), 1u)};
+	return *pool;
+}
+
+pragma::filesystem::FileInfo pragma::filesystem::FileManager::GetFileInfo(std::string name, SearchFlags includeFlags, SearchFlags excludeFlags, bool includeDetails)
+{
+	FileInfo info {};
+	NormalizePath(name);
+	if(name.empty())
+		return info;
+	if((includeFlags & SearchFlags::Virtual) == SearchFlags::Virtual && find_virtual_file_info(*GetVirtualSnapshot(), name, info))
+		return info;
+	if((includeFlags & SearchFlags::Package) == SearchFlags::Package) {
+		std::shared_lock lock {g_packageMutex};
+		if(find_package_file_info(*get_package_index(), name, includeFlags, includeDetails, info))
+			return info;
 	}
 	if((includeFlags & SearchFlags::Local) == SearchFlags::None)
-		return FVFile::Invalid;
+		return info;
 
 	auto *fic = get_root_path_file_cache_manager();
 	if(fic && fic->IsComplete()) {
 		auto type = fic->FindFileType(name);
-		FVFile flags = FVFile::None;
-		switch(type) {
-		case FileIndexCache::Type::Directory:
-			flags |= FVFile::Directory;
-			break;
-		case FileIndexCache::Type::Invalid:
-			return FVFile::Invalid;
-		default:
-			break;
-		}
-		return flags;
+		if(type == FileIndexCache::Type::Invalid)
+			return info;
+		// The index doesn't know which mount the file is in, so without a stat the layer stays at FileLayer::Root
+		info.flags = (type == FileIndexCache::Type::Directory) ? FVFile::Directory : FVFile::None;
+		if(!includeDetails)
+			return info;
 	}
 
+	std::string path;
 	std::shared_lock lock {g_customMountMutex};
 	for(auto &rootPath : get_absolute_root_paths()) {
 		auto appPath = rootPath.GetString();
@@ -1123,21 +1909,110 @@ pragma::filesystem::FVFile pragma::filesystem::FileManager::GetFileFlags(std::st
 		std::string mountPath;
 		bool bAbsolute = false;
 		while(it.GetNextDirectory(mountPath, includeFlags, excludeFlags, bAbsolute)) {
-			auto flags = update_file_insensitive_path_components_and_get_flags(appPath, mountPath, bAbsolute, name);
-			if(flags != FVFile::Invalid)
-				return flags;
+			path = bAbsolute ? mountPath : (appPath + DIR_SEPARATOR + mountPath);
+			path += DIR_SEPARATOR;
+			path += name;
+			if(stat_local_file_any_case(path, info, includeDetails)) {
+				info.layer = (mountPath == ".") ? FileLayer::Root : FileLayer::Mount;
+				return info;
+			}
 		}
 	}
-	return FVFile::Invalid;
-}
+	return info;
+}
+
+std::vector<pragma::filesystem::FileInfo> pragma::filesystem::FileManager::GetFileInfos(std::span<const std::string> paths, SearchFlags includeFlags, SearchFlags excludeFlags, bool includeDetails)
+{
+	std::vector<FileInfo> infos(paths.size());
+	std::vector<std::string> names;
+	names.reserve(paths.size());
+	// Indices of the paths that haven't been found yet
+	std::vector<size_t> pending;
+	pending.reserve(paths.size());
+	for(size_t i = 0; i < paths.size(); ++i) {
+		auto name = paths[i];
+		NormalizePath(name);
+		if(!name.empty())
+			pending.push_back(i);
+		names.push_back(std::move(name));
+	}
+	if((includeFlags & SearchFlags::Virtual) == SearchFlags::Virtual && !pending.empty()) {
+		auto snapshot = GetVirtualSnapshot();
+		std::erase_if(pending, [&](size_t i) { return find_virtual_file_info(*snapshot, names[i], infos[i]); });
+	}
+	if((includeFlags & SearchFlags::Package) == SearchFlags::Package && !pending.empty()) {
+		std::shared_lock lock {g_packageMutex};
+		auto index = get_package_index();
+		std::erase_if(pending, [&](size_t i) { return find_package_file_info(*index, names[i], includeFlags, includeDetails, infos[i]); });
+	}
+	if((includeFlags & SearchFlags::Local) == SearchFlags::None || pending.empty())
+		return infos;
 
-bool pragma::filesystem::FileManager::IsFile(std::string name, SearchFlags fsearchmode)
-{
-	auto flags = GetFileFlags(name, fsearchmode);
-	return (flags != FVFile::Invalid && (flags & FVFile::Directory) == FVFile::None) ? true : false;
-}
+	auto *fic = get_root_path_file_cache_manager();
+	if(fic && fic->IsComplete()) {
+		// The index decides whether a file exists, only the details of the files that were found still require a stat
+		std::erase_if(pending, [&](size_t i) {
+			auto type = fic->FindFileType(names[i]);
+			if(type == FileIndexCache::Type::Invalid)
+				return true;
+			// The index doesn't know which mount the file is in, so without a stat the layer stays at FileLayer::Root
+			infos[i].flags = (type == FileIndexCache::Type::Directory) ? FVFile::Directory : FVFile::None;
+			return !includeDetails;
+		});
+		if(pending.empty())
+			return infos;
+	}
 
-bool pragma::filesystem::FileManager::IsDir(std::string name, SearchFlags fsearchmode) { return (GetFileFlags(name, fsearchmode) & FVFile::Directory) == FVFile::Directory; }
+	struct LocalDirectory {
+		std::string path;
+		FileLayer layer;
+	};
+	std::vector<LocalDirectory> dirs;
+	std::shared_lock lock {g_customMountMutex};
+	for(auto &rootPath : get_absolute_root_paths()) {
+		auto appPath = rootPath.GetString();
+		MountIterator it(m_customMount);
+		std::string mountPath;
+		bool bAbsolute = false;
+		while(it.GetNextDirectory(mountPath, includeFlags, excludeFlags, bAbsolute)) {
+			auto path = bAbsolute ? mountPath : (appPath + DIR_SEPARATOR + mountPath);
+			path += DIR_SEPARATOR;
+			dirs.push_back({std::move(path), (mountPath == ".") ? FileLayer::Root : FileLayer::Mount});
+		}
+	}
+	auto statFile = [&dirs, &names, &infos, includeDetails](size_t i) {
+		auto &info = infos[i];
+		for(auto &dir : dirs) {
+			auto path = dir.path + names[i];
+			if(stat_local_file_any_case(path, info, includeDetails)) {
+				info.layer = dir.layer;
+				return;
+			}
+		}
+	};
+	// Below this number of files the thread pool would cost more than it saves
+	constexpr size_t PARALLEL_STAT_THRESHOLD = 64;
+	if(pending.size() < PARALLEL_STAT_THRESHOLD) {
+		for(auto i : pending)
+			statFile(i);
+		return infos;
+	}
+	auto &pool = get_stat_thread_pool();
+	auto batchSize = std::max<size_t>(pending.size() / (pool.get_thread_count() * 4), 1);
+	// The pool is shared with concurrent calls, so only the tasks of this call are waited for
+	std::vector<std::future<void>> batches;
+	batches.reserve((pending.size() + batchSize - 1) / batchSize);
+	for(size_t start = 0; start < pending.size(); start += batchSize) {
+		auto end = std::min(start + batchSize, pending.size());
+		batches.push_back(pool.submit_task([&statFile, &pending, start, end]() {
+			for(auto i = start; i < end; ++i)
+				statFile(pending[i]);
+		}));
+	}
+	for(auto &batch : batches)
+		batch.wait();
+	return infos;
+}
 
 bool pragma::filesystem::FileManager::ExistsSystem(std::string name)
 {
@@ -1261,62 +2136,84 @@ bool pragma::filesystem::FileManager::ComparePath(const std::string &a, const st
 
 //////////////////////////
 
-pragma::filesystem::VFile *pragma::filesystem::VDirectory::GetFile(std::string path)
+pragma::filesystem::VData *pragma::filesystem::VDirectory::Find(std::string_view path, bool file)
 {
-	string::to_lower(path);
-	NormalizePath(path);
-	size_t sp = path.find_first_of("/\\");
-	if(sp != string::NOT_FOUND) {
-		std::string subDir = path.substr(0, sp);
-		path = path.substr(sp + 1);
-		VDirectory *sub = GetDirectory(subDir);
-		if(sub == NULL)
-			return NULL;
-		return sub->GetFile(path);
+	// Relative path components have to be resolved first, otherwise the path can be walked as-is
+	std::string normalizedPath;
+	if(path.find("..") != std::string_view::npos) {
+		normalizedPath = FileManager::GetNormalizedPath(std::string {path});
+		path = normalizedPath;
+	}
+	VDirectory *dir = this;
+	for(;;) {
+		auto sp = path.find_first_of("/\\");
+		if(sp == std::string_view::npos)
+			break;
+		auto component = path.substr(0, sp);
+		path.remove_prefix(sp + 1);
+		if(component.empty() || component == ".")
+			continue;
+		// File lookups lowercase the whole path, directory lookups match exactly
+		dir = dir->FindDirectory(component, file);
+		if(!dir)
+			return nullptr;
 	}
-	for(unsigned int i = 0; i < m_files.size(); i++) {
-		if(m_files[i]->IsFile() && string::compare(m_files[i]->GetName().c_str(), path.c_str(), false))
-			return static_cast<VFile *>(m_files[i]);
+	if(path.empty() || path == ".")
+		return (!file && dir != this) ? dir : nullptr;
+	if(file) {
+		auto it = dir->m_fileIndex.find(path);
+		return (it != dir->m_fileIndex.end()) ? it->second : nullptr;
 	}
-	return NULL;
+	return dir->FindDirectory(path);
 }
 
-pragma::filesystem::VDirectory *pragma::filesystem::VDirectory::GetDirectory(std::string path)
+pragma::filesystem::VDirectory *pragma::filesystem::VDirectory::FindDirectory(std::string_view name, bool lowerCase)
 {
-	NormalizePath(path);
-	if(!path.empty() && path.back() == DIR_SEPARATOR)
-		path = path.substr(0, path.length() - 1);
-	size_t sp = path.find_first_of("/\\");
-	if(sp != string::NOT_FOUND) {
-		std::string subDir = path.substr(0, sp);
-		path = path.substr(sp + 1);
-		VDirectory *sub = GetDirectory(subDir);
-		if(sub == NULL)
-			return NULL;
-		return sub->GetDirectory(path);
-	}
-	for(unsigned int i = 0; i < m_files.size(); i++) {
-		if(m_files[i]->IsDirectory() && m_files[i]->GetName() == path)
-			return static_cast<VDirectory *>(m_files[i]);
+	auto it = m_directoryIndex.find(name);
+	if(it == m_directoryIndex.end())
+		return nullptr;
+	// The index is case-insensitive, but directory names have to match the (lowercased) name exactly
+	auto matches = [name, lowerCase](std::string_view other) {
+		if(!lowerCase)
+			return other == name;
+		return other.length() == name.length() && std::equal(other.begin(), other.end(), name.begin(), [](char a, char b) { return a == static_cast<char>(std::tolower(static_cast<unsigned char>(b))); });
+	};
+	if(matches(it->second->GetName()))
+		return it->second;
+	for(auto *child : m_files) {
+		if(child->IsDirectory() && matches(child->GetName()))
+			return static_cast<VDirectory *>(child);
 	}
-	return NULL;
+	return nullptr;
 }
 
-pragma::filesystem::VDirectory *pragma::filesystem::VDirectory::AddDirectory(std::string name)
+pragma::filesystem::VFile *pragma::filesystem::VDirectory::GetFile(const std::string_view &path) { return static_cast<VFile *>(Find(path, true)); }
+
+pragma::filesystem::VDirectory *pragma::filesystem::VDirectory::GetDirectory(const std::string_view &path) { return static_cast<VDirectory *>(Find(path, false)); }
+
+pragma::filesystem::VDirectory *pragma::filesystem::VDirectory::AddDirectory(const std::string_view &name)
 {
-	size_t sp = name.find_first_of("\\/");
-	if(sp != string::NOT_FOUND) {
-		std::string dir = name.substr(0, sp);
-		VDirectory *subdir = AddDirectory(dir);
-		std::string sub = name.substr(sp + 1);
-		return subdir->AddDirectory(sub);
+	VDirectory *dir = this;
+	std::string_view path = name;
+	while(!path.empty()) {
+		auto sp = path.find_first_of("\\/");
+		auto component = path.substr(0, sp);
+		path = (sp != std::string_view::npos) ? path.substr(sp + 1) : std::string_view {};
+		if(component.empty())
+			continue;
+		if(auto *existing = dir->FindDirectory(component)) {
+			dir = existing;
+			continue;
+		}
+		VDirectory *subDir;
+		if(m_childArena)
+			subDir = m_childArena->Create<VDirectory>(VData::InternedName {m_childArena->Intern(component)}, *m_childArena);
+		else
+			subDir = new VDirectory(std::string {component});
+		dir->Add(subDir);
+		dir = subDir;
 	}
-	VDirectory *find = GetDirectory(name);
-	if(find != NULL)
-		return find;
-	find = new VDirectory(name);
-	m_files.push_back(find);
-	return find;
+	return dir;
 }
 
 //////////////////////////
@@ -1334,6 +2231,8 @@ int pragma::filesystem::VFilePtrInternalReal::Eof() { return feof(m_file); }
 
 int pragma::filesystem::VFilePtrInternalReal::ReadChar() { return fgetc(m_file); }
 
+void pragma::filesystem::VFilePtrInternalReal::UnreadChar(int c) { ungetc(c, m_file); }
+
 int pragma::filesystem::VFilePtrInternalReal::WriteString(const std::string_view &sv, bool withBinaryZeroByte)
 {
 	auto len = sv.length();
@@ -1353,11 +2252,10 @@ size_t pragma::filesystem::VFilePtrInternalVirtual::Read(void *ptr, size_t size)
 {
 	if(Eof() == EOF)
 		return 0;
-	unsigned long long szMin = m_file->GetSize() - m_offset;
+	unsigned long long szMin = m_size - m_offset;
 	if(size > szMin)
 		size = szMin;
-	auto data = m_file->GetData();
-	memcpy(ptr, data->data() + m_offset, size);
+	memcpy(ptr, m_data + m_offset, size);
 	m_offset += size;
 	return size;
 }
@@ -1366,14 +2264,110 @@ unsigned long long pragma::filesystem::VFilePtrInternalVirtual::Tell() { return
 
 void pragma::filesystem::VFilePtrInternalVirtual::Seek(unsigned long long offset) { m_offset = offset; }
 
-int pragma::filesystem::VFilePtrInternalVirtual::Eof() { return ((m_offset < m_file->GetSize()) ? 0 : EOF); }
+int pragma::filesystem::VFilePtrInternalVirtual::Eof() { return ((m_offset < m_size) ? 0 : EOF); }
 
 int pragma::filesystem::VFilePtrInternalVirtual::ReadChar()
 {
 	if(Eof() == EOF)
 		return EOF;
-	auto data = m_file->GetData();
-	char c = data->at(m_offset);
+	char c = m_data[m_offset];
+	m_offset++;
+	return c;
+}
+
+//////////////////////////
+
+pragma::filesystem::VFilePtrInternalMemory::VFilePtrInternalMemory(std::string path, const std::shared_ptr<std::vector<uint8_t>> &data, uint64_t reserved, bool append)
+    : VFilePtrInternal(), m_path {std::move(path)}, m_data {data}, m_reserved {reserved}, m_append {append}
+{
+	m_type = EVFile::Virtual;
+	m_bWritable = true;
+	if(append)
+		m_offset = m_data->size();
+}
+
+pragma::filesystem::VFilePtrInternalMemory::~VFilePtrInternalMemory()
+{
+	Flush();
+	if(m_reserved > 0)
+		g_overlayUsage -= m_reserved;
+}
+
+const std::string &pragma::filesystem::VFilePtrInternalMemory::GetPath() const { return m_path; }
+
+void pragma::filesystem::VFilePtrInternalMemory::Flush()
+{
+	if(!m_dirty)
+		return;
+	FileManager::CommitWritableVirtualFile(m_path, m_data, m_reserved);
+	m_published = true;
+	m_dirty = false;
+}
+
+bool pragma::filesystem::VFilePtrInternalMemory::PrepareWrite(uint64_t newSize)
+{
+	// Existing contents are only charged to the budget once they're written to
+	auto size = std::max<uint64_t>(newSize, m_data->size());
+	if(m_published) {
+		// Copy-on-write, the published contents may still be read by other handles
+		if(!reserve_overlay_memory(size))
+			return false;
+		m_data = std::make_shared<std::vector<uint8_t>>(*m_data);
+		m_reserved = size;
+		m_published = false;
+	}
+	else if(size > m_reserved) {
+		if(!reserve_overlay_memory(size - m_reserved))
+			return false;
+		m_reserved = size;
+	}
+	if(newSize > m_data->size())
+		m_data->resize(newSize);
+	m_dirty = true;
+	return true;
+}
+
+size_t pragma::filesystem::VFilePtrInternalMemory::Write(const void *ptr, size_t size)
+{
+	if(size == 0)
+		return 0;
+	if(m_append)
+		m_offset = m_data->size();
+	if(!PrepareWrite(m_offset + size))
+		return 0;
+	memcpy(m_data->data() + m_offset, ptr, size);
+	m_offset += size;
+	// Same as VFilePtrInternalReal::Write, which returns the number of items written by fwrite
+	return 1;
+}
+
+size_t pragma::filesystem::VFilePtrInternalMemory::Read(void *ptr, size_t size)
+{
+	if(Eof() == EOF)
+		return 0;
+	unsigned long long szMin = m_data->size() - m_offset;
+	if(size > szMin)
+		size = szMin;
+	memcpy(ptr, m_data->data() + m_offset, size);
+	m_offset += size;
+	return size;
+}
+
+unsigned long long pragma::filesystem::VFilePtrInternalMemory::Tell() { return m_offset; }
+
+void pragma::filesystem::VFilePtrInternalMemory::Seek(unsigned long long offset) { m_offset = offset; }
+
+int pragma::filesystem::VFilePtrInternalMemory::Eof() { return ((m_offset < m_data->size()) ? 0 : EOF); }
+
+int pragma::filesystem::VFilePtrInternalMemory::ReadChar()
+{
+	if(Eof() == EOF)
+		return EOF;
+	char c = (*m_data)[m_offset];
 	m_offset++;
 	return c;
 }
+
+unsigned long long pragma::filesystem::VFilePtrInternalMemory::GetSize() { return m_data->size(); }
+
+std::span<const uint8_t> pragma::filesystem::VFilePtrInternalMemory::GetMemory() { return {m_data->data(), m_data->size()}; }
@@ -11,6 +11,7 @@ module;
 #define DIR_SEPARATOR '/'
 #define DIR_SEPARATOR_OTHER '\\'
 #else
+#include <Windows.h>
 #include "Shlwapi.h"
 #define DIR_SEPARATOR '\\'
 #define DIR_SEPARATOR_OTHER '/'
@@ -20,6 +21,7 @@ module;
 module pragma.filesystem;
 
 import :file_system;
+import :glob;
 
 #undef CreateDirectory
 #undef GetFileAttributes
@@ -168,10 +170,11 @@ pragma::filesystem::VFilePtr pragma::filesystem::open_file(const std::string_vie
 
 bool pragma::filesystem::write_file(const std::string_view &path, const std::string_view &contents)
 {
-	auto f = open_file<VFilePtrReal>(path, FileMode::Write | FileMode::Binary);
+	auto f = open_file(path, FileMode::Write | FileMode::Binary);
 	if(!f)
 		return false;
-	f->WriteString(contents, false);
+	if(!contents.empty())
+		File {f}.Write(contents.data(), contents.size());
 	return true;
 }
 std::optional<std::string> pragma::filesystem::read_file(const std::string_view &path)
@@ -200,7 +203,22 @@ pragma::filesystem::VFilePtrReal pragma::filesystem::open_system_file(const std:
 bool pragma::filesystem::create_path(const std::string_view &path) { return FileManager::CreatePath(std::string {path}.c_str()); }
 bool pragma::filesystem::create_directory(const std::string_view &dir) { return FileManager::CreateDirectory(dir.data()); }
 std::pair<pragma::filesystem::VDirectory *, pragma::filesystem::VFile *> pragma::filesystem::add_virtual_file(const std::string_view &path, const std::shared_ptr<std::vector<uint8_t>> &data) { return FileManager::AddVirtualFile(path.data(), data); }
+std::pair<pragma::filesystem::VDirectory *, pragma::filesystem::VFile *> pragma::filesystem::add_virtual_file(const std::string_view &path, const std::shared_ptr<const VFileStorage> &storage) { return FileManager::AddVirtualFile(std::string {path}, storage); }
+std::pair<pragma::filesystem::VDirectory *, pragma::filesystem::VFile *> pragma::filesystem::add_generated_virtual_file(const std::string_view &path, const VFileGeneratorStorage::Generator &generator, std::optional<unsigned long long> sizeHint)
+{
+	return FileManager::AddVirtualFile(std::string {path}, std::make_shared<VFileGeneratorStorage>(generator, sizeHint));
+}
 pragma::filesystem::VDirectory *pragma::filesystem::get_root_directory() { return FileManager::GetRootDirectory(); }
+void pragma::filesystem::clear_virtual_files() { FileManager::ClearVirtualFiles(); }
+bool pragma::filesystem::remove_virtual_file(const std::string_view &path) { return FileManager::RemoveVirtualFile(std::string {path}); }
+void pragma::filesystem::add_writable_virtual_path(const std::string_view &path) { FileManager::AddWritableVirtualPath(std::string {path}); }
+void pragma::filesystem::remove_writable_virtual_path(const std::string_view &path) { FileManager::RemoveWritableVirtualPath(std::string {path}); }
+bool pragma::filesystem::is_writable_virtual_path(const std::string_view &path) { return FileManager::IsWritableVirtualPath(std::string {path}); }
+void pragma::filesystem::set_writable_virtual_memory_budget(uint64_t budget) { FileManager::SetWritableVirtualMemoryBudget(budget); }
+uint64_t pragma::filesystem::get_writable_virtual_memory_usage() { return FileManager::GetWritableVirtualMemoryUsage(); }
+uint32_t pragma::filesystem::flush_writable_virtual_files(const std::string_view &path, bool release) { return FileManager::FlushWritableVirtualFiles(std::string {path}, release); }
+std::shared_ptr<const pragma::filesystem::VirtualSnapshot> pragma::filesystem::get_virtual_snapshot() { return FileManager::GetVirtualSnapshot(); }
+void pragma::filesystem::modify_virtual_files(const std::function<void(VDirectory &)> &f) { FileManager::ModifyVirtualFiles(f); }
 pragma::filesystem::Package *pragma::filesystem::load_package(const std::string_view &package, SearchFlags searchMode) { return FileManager::LoadPackage(package.data(), searchMode); }
 void pragma::filesystem::clear_packages(SearchFlags searchMode) { FileManager::ClearPackages(searchMode); }
 void pragma::filesystem::register_packet_manager(const std::string_view &name, std::unique_ptr<PackageManager> pm) { FileManager::RegisterPackageManager(std::string {name}, std::move(pm)); }
@@ -236,6 +254,20 @@ std::string pragma::filesystem::get_sub_path(const std::string_view &path) { ret
 std::optional<std::filesystem::file_time_type> pragma::filesystem::get_last_write_time(const std::string_view &path, SearchFlags includeFlags, SearchFlags excludeFlags) { return FileManager::GetLastWriteTime(path, includeFlags, excludeFlags); }
 std::uint64_t pragma::filesystem::get_file_size(const std::string_view &name, SearchFlags fsearchmode) { return FileManager::GetFileSize(std::string {name}, fsearchmode); }
 bool pragma::filesystem::exists(const std::string_view &name, SearchFlags includeFlags, SearchFlags excludeFlags) { return FileManager::Exists(std::string {name}, includeFlags, excludeFlags); }
+pragma::filesystem::FileInfo pragma::filesystem::get_file_info(const std::string_view &path, SearchFlags includeFlags, SearchFlags excludeFlags) { return FileManager::GetFileInfo(std::string {path}, includeFlags, excludeFlags); }
+std::vector<bool> pragma::filesystem::exists_many(std::span<const std::string> paths, SearchFlags includeFlags, SearchFlags excludeFlags)
+{
+	auto infos = FileManager::GetFileInfos(paths, includeFlags, excludeFlags, false);
+	std::vector<bool> results(infos.size());
+	for(size_t i = 0; i < infos.size(); ++i)
+		results[i] = infos[i].Exists();
+	return results;
+}
+std::vector<pragma::filesystem::FileInfo> pragma::filesystem::stat_many(std::span<const std::string> paths, SearchFlags includeFlags, SearchFlags excludeFlags) { return FileManager::GetFileInfos(paths, includeFlags, excludeFlags); }
+std::optional<std::string> pragma::filesystem::resolve_available_file(const std::string &baseName, const std::vector<std::string_view> &extensions, SearchFlags includeFlags, SearchFlags excludeFlags)
+{
+	return FileManager::FindAvailableFile(baseName, extensions, includeFlags, excludeFlags);
+}
 bool pragma::filesystem::is_file(const std::string_view &name, SearchFlags fsearchmode) { return FileManager::IsFile(std::string {name}, fsearchmode); }
 bool pragma::filesystem::is_dir(const std::string_view &name, SearchFlags fsearchmode) { return FileManager::IsDir(std::string {name}, fsearchmode); }
 bool pragma::filesystem::exists_system(const std::string_view &name) { return FileManager::ExistsSystem(std::string {name}); }
@@ -249,6 +281,7 @@ void pragma::filesystem::find_files(const std::string_view &cfind, std::vector<s
 	FileManager::FindFiles(cfind.data(), resfiles, resdirs, bKeepPath, includeFlags, excludeFlag);
 }
 void pragma::filesystem::find_files(const std::string_view &cfind, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, SearchFlags includeFlags, SearchFlags excludeFlags) { FileManager::FindFiles(cfind.data(), resfiles, resdirs, includeFlags, excludeFlags); }
+bool pragma::filesystem::visit_files(const std::string_view &cfind, const DirectoryVisitor &visitor, bool includeSize, SearchFlags includeFlags, SearchFlags excludeFlags) { return FileManager::VisitFiles(std::string {cfind}.c_str(), visitor, includeSize, includeFlags, excludeFlags); }
 void pragma::filesystem::find_system_files(const std::string_view &path, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, bool bKeepPath) { FileManager::FindSystemFiles(path.data(), resfiles, resdirs, bKeepPath); }
 bool pragma::filesystem::copy_file(const std::string_view &cfile, const std::string_view &cfNewPath) { return FileManager::CopyFile(cfile.data(), cfNewPath.data()); }
 bool pragma::filesystem::copy_system_file(const std::string_view &cfile, const std::string_view &cfNewPath) { return FileManager::CopySystemFile(cfile.data(), cfNewPath.data()); }
@@ -275,3 +308,108 @@ pragma::filesystem::VFilePtr pragma::filesystem::open_package_file(const std::st
 pragma::filesystem::PackageManager *pragma::filesystem::get_package_manager(const std::string_view &name) { return FileManager::GetPackageManager(name.data()); }
 
 bool pragma::filesystem::compare_path(const std::string_view &a, const std::string_view &b) { return FileManager::ComparePath(a.data(), b.data()); }
+
+#ifdef _WIN32
+std::optional<std::wstring> string_to_wstring(const std::string &str);
+#endif
+
+// Returns the device and inode (or volume and file index) of the directory at the specified absolute path, following links
+static std::optional<std::pair<uint64_t, uint64_t>> get_directory_id(const std::string &path)
+{
+#ifdef __linux__
+	struct stat st {};
+	if(::stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+		return {};
+	return std::pair<uint64_t, uint64_t> {static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)};
+#else
+	auto wpath = string_to_wstring(path);
+	if(!wpath)
+		return {};
+	auto hFile = CreateFileW(wpath->c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+	if(hFile == INVALID_HANDLE_VALUE)
+		return {};
+	BY_HANDLE_FILE_INFORMATION info {};
+	auto res = GetFileInformationByHandle(hFile, &info);
+	CloseHandle(hFile);
+	if(!res || (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+		return {};
+	return std::pair<uint64_t, uint64_t> {info.dwVolumeSerialNumber, (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow};
+#endif
+}
+
+bool pragma::filesystem::walk_directory(const std::string_view &path, const WalkVisitor &visitor, const WalkOptions &options)
+{
+	std::string root {path};
+	std::replace(root.begin(), root.end(), '\\', '/');
+	while(!root.empty() && root.back() == '/')
+		root.pop_back();
+
+	std::atomic<bool> cancelled = false;
+	std::mutex visitedMutex;
+	std::set<std::pair<uint64_t, uint64_t>> visitedDirectories;
+	// Records the physical directories behind the specified path on all mounts.
+	// Returns false if all of them have already been visited.
+	auto markVisited = [&visitedMutex, &visitedDirectories, &options](const std::string &dirPath) {
+		std::vector<std::pair<uint64_t, uint64_t>> ids;
+		for(auto &absPath : FileManager::FindAbsolutePaths(dirPath, options.includeFlags, options.excludeFlags)) {
+			if(auto id = get_directory_id(absPath))
+				ids.push_back(*id);
+		}
+		// Directories that only exist in packages can't form cycles
+		auto isNew = ids.empty();
+		std::scoped_lock lock {visitedMutex};
+		for(auto &id : ids) {
+			if(visitedDirectories.insert(id).second)
+				isNew = true;
+		}
+		return isNew;
+	};
+	// Links can only form cycles if they're followed
+	if(options.followSymlinks)
+		markVisited(root);
+
+	auto filter = Glob::Compile(options.filter);
+	auto matchPath = filter.HasMultipleSegments();
+	auto threadCount = (options.threadCount == 0) ? std::max(std::thread::hardware_concurrency(), 1u) : options.threadCount;
+	BS::light_thread_pool pool {threadCount};
+	std::function<void(const std::string &, uint32_t)> walk;
+	walk = [&](const std::string &dirPath, uint32_t depth) {
+		if(cancelled)
+			return;
+		auto prefix = dirPath.empty() ? std::string {} : (dirPath + '/');
+		auto descend = !options.maxDepth || depth < *options.maxDepth;
+		// Sub-directories and whether they're symbolic links
+		std::vector<std::pair<std::string, bool>> subDirs;
+		std::string entryPath;
+		std::string_view relPath;
+		auto completed = FileManager::VisitFiles(
+		  (prefix + '*').c_str(),
+		  [&](const DirectoryEntry &entry) {
+			  if(cancelled)
+				  return false;
+			  entryPath = prefix;
+			  entryPath += entry.name;
+			  relPath = root.empty() ? std::string_view {entryPath} : std::string_view {entryPath}.substr(root.size() + 1);
+			  if(entry.directory && descend && (!matchPath || filter.CanMatchBelow(relPath)) && (!entry.symbolicLink || options.followSymlinks))
+				  subDirs.push_back({entryPath, entry.symbolicLink});
+			  if(!filter.Match(matchPath ? relPath : entry.name))
+				  return true;
+			  return visitor(entryPath, entry);
+		  },
+		  options.includeSize, options.includeFlags, options.excludeFlags);
+		if(!completed) {
+			cancelled = true;
+			return;
+		}
+		// Link targets are resolved after the listing, since the mounts are locked during it
+		for(auto &[subDir, symbolicLink] : subDirs) {
+			if(options.followSymlinks && !markVisited(subDir) && symbolicLink)
+				continue;
+			pool.detach_task([&walk, subDir = std::move(subDir), depth]() { walk(subDir, depth + 1); });
+		}
+	};
+	walk(root, 0);
+	// Tasks are queued before the task that found them finishes, so this also waits for all sub-directories
+	pool.wait();
+	return !cancelled;
+}
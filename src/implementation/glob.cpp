@@ -0,0 +1,313 @@
+// SPDX-FileCopyrightText: (c) 2026 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.filesystem;
+
+import :glob;
+
+// Upper limit for the number of alternatives produced by brace expansion
+static constexpr size_t MAX_ALTERNATIVES = 1024;
+
+static size_t find_closing_brace(const std::string_view &pattern, size_t open, bool &outHasComma)
+{
+	outHasComma = false;
+	uint32_t depth = 0;
+	for(auto i = open; i < pattern.size(); ++i) {
+		switch(pattern[i]) {
+		case '{':
+			++depth;
+			break;
+		case '}':
+			if(--depth == 0)
+				return i;
+			break;
+		case ',':
+			if(depth == 1)
+				outHasComma = true;
+			break;
+		}
+	}
+	return std::string_view::npos;
+}
+
+static void expand_braces(const std::string_view &pattern, std::vector<std::string> &outPatterns)
+{
+	for(size_t open = pattern.find('{'); open != std::string_view::npos; open = pattern.find('{', open + 1)) {
+		bool hasComma;
+		auto close = find_closing_brace(pattern, open, hasComma);
+		if(close == std::string_view::npos)
+			break;
+		if(!hasComma)
+			continue;
+		auto prefix = pattern.substr(0, open);
+		auto suffix = pattern.substr(close + 1);
+		uint32_t depth = 0;
+		auto start = open + 1;
+		for(auto i = open + 1; i <= close; ++i) {
+			auto c = pattern[i];
+			if(c == '{')
+				++depth;
+			else if(c == '}' && depth > 0)
+				--depth;
+			else if((c == ',' && depth == 0) || i == close) {
+				if(outPatterns.size() >= MAX_ALTERNATIVES)
+					return;
+				std::string alternative {prefix};
+				alternative += pattern.substr(start, i - start);
+				alternative += suffix;
+				expand_braces(alternative, outPatterns);
+				start = i + 1;
+			}
+		}
+		return;
+	}
+	outPatterns.push_back(std::string {pattern});
+}
+
+static std::vector<std::string_view> split_path(const std::string_view &path)
+{
+	std::vector<std::string_view> parts;
+	size_t start = 0;
+	for(size_t i = 0; i <= path.size(); ++i) {
+		if(i < path.size() && path[i] != '/' && path[i] != '\\')
+			continue;
+		if(i > start)
+			parts.push_back(path.substr(start, i - start));
+		start = i + 1;
+	}
+	return parts;
+}
+
+pragma::filesystem::Glob::Glob() : m_pattern {"*"}, m_literal {false}, m_matchesAll {true}
+{
+	Segment segment {};
+	segment.tokens.push_back({Token::Type::AnyString});
+	m_alternatives.push_back({std::move(segment)});
+}
+
+char pragma::filesystem::Glob::Normalize(char c) const { return m_caseSensitive ? c : static_cast<char>(std::tolower(static_cast<unsigned char>(c))); }
+
+pragma::filesystem::Glob pragma::filesystem::Glob::Compile(const std::string_view &pattern, bool caseSensitive, Syntax syntax)
+{
+	Glob glob {};
+	glob.m_pattern = pattern;
+	glob.m_caseSensitive = caseSensitive;
+	glob.m_alternatives.clear();
+	glob.m_literal = true;
+	glob.m_matchesAll = false;
+
+	auto extended = (syntax == Syntax::Extended);
+	std::vector<std::string> patterns;
+	if(extended)
+		expand_braces(pattern, patterns);
+	else
+		patterns.push_back(std::string {pattern});
+	glob.m_literal = (patterns.size() == 1);
+	for(auto &strPattern : patterns) {
+		Alternative alternative;
+		for(auto &part : split_path(strPattern)) {
+			Segment segment {};
+			if(part == "**" && extended) {
+				// Consecutive "**" segments are redundant
+				if(alternative.empty() || !alternative.back().recursive) {
+					segment.recursive = true;
+					alternative.push_back(std::move(segment));
+				}
+				glob.m_literal = false;
+				continue;
+			}
+			for(size_t i = 0; i < part.size(); ++i) {
+				auto c = part[i];
+				switch(c) {
+				case '*':
+					if(segment.tokens.empty() || segment.tokens.back().type != Token::Type::AnyString)
+						segment.tokens.push_back({Token::Type::AnyString});
+					glob.m_literal = false;
+					continue;
+				case '?':
+					segment.tokens.push_back({Token::Type::AnyChar});
+					glob.m_literal = false;
+					continue;
+				case '[':
+					if(extended) {
+						auto start = i + 1;
+						auto negate = start < part.size() && (part[start] == '!' || part[start] == '^');
+						if(negate)
+							++start;
+						// A ']' directly after the opening bracket is part of the class
+						auto close = part.find(']', (start < part.size()) ? (start + 1) : start);
+						if(close == std::string_view::npos)
+							break;
+						std::bitset<256> charClass {};
+						auto add = [&charClass, caseSensitive](unsigned char c) {
+							charClass.set(c);
+							if(!caseSensitive) {
+								charClass.set(std::tolower(c));
+								charClass.set(std::toupper(c));
+							}
+						};
+						for(auto j = start; j < close; ++j) {
+							auto first = static_cast<unsigned char>(part[j]);
+							if(j + 2 < close && part[j + 1] == '-') {
+								auto last = static_cast<unsigned char>(part[j + 2]);
+								for(auto k = static_cast<uint32_t>(first); k <= last; ++k)
+									add(static_cast<unsigned char>(k));
+								j += 2;
+							}
+							else
+								add(first);
+						}
+						if(negate)
+							charClass.flip();
+						Token token {Token::Type::CharClass};
+						token.charClass = static_cast<uint16_t>(glob.m_charClasses.size());
+						glob.m_charClasses.push_back(charClass);
+						segment.tokens.push_back(token);
+						glob.m_literal = false;
+						i = close;
+						continue;
+					}
+					break;
+				}
+				Token token {Token::Type::Literal};
+				token.literal = glob.Normalize(c);
+				segment.tokens.push_back(token);
+			}
+			alternative.push_back(std::move(segment));
+		}
+		if(alternative.size() > 1 || (!alternative.empty() && alternative.front().recursive))
+			glob.m_multipleSegments = true;
+		glob.m_alternatives.push_back(std::move(alternative));
+	}
+	glob.m_matchesAll = glob.m_alternatives.size() == 1 && glob.m_alternatives.front().size() == 1 && !glob.m_alternatives.front().front().recursive && glob.m_alternatives.front().front().tokens.size() == 1
+	  && glob.m_alternatives.front().front().tokens.front().type == Token::Type::AnyString;
+
+	// Literal directories that are shared by all alternatives
+	auto isLiteral = [](const Segment &segment) { return !segment.recursive && std::all_of(segment.tokens.begin(), segment.tokens.end(), [](const Token &token) { return token.type == Token::Type::Literal; }); };
+	auto toString = [](const Segment &segment) {
+		std::string str;
+		str.reserve(segment.tokens.size());
+		for(auto &token : segment.tokens)
+			str += token.literal;
+		return str;
+	};
+	if(!glob.m_alternatives.empty()) {
+		auto &first = glob.m_alternatives.front();
+		for(size_t i = 0; i + 1 < first.size() && isLiteral(first[i]); ++i) {
+			auto segment = toString(first[i]);
+			auto shared = std::all_of(glob.m_alternatives.begin() + 1, glob.m_alternatives.end(), [&](const Alternative &alternative) { return i + 1 < alternative.size() && isLiteral(alternative[i]) && toString(alternative[i]) == segment; });
+			if(!shared)
+				break;
+			glob.m_literalPrefix += segment;
+			glob.m_literalPrefix += '/';
+		}
+	}
+	return glob;
+}
+
+bool pragma::filesystem::Glob::MatchSegment(const Segment &segment, const std::string_view &name) const
+{
+	auto &tokens = segment.tokens;
+	size_t t = 0;
+	size_t n = 0;
+	// Position of the last '*' and the position in the name it was matched at, for backtracking
+	auto starToken = std::numeric_limits<size_t>::max();
+	size_t starName = 0;
+	while(n < name.size()) {
+		if(t < tokens.size()) {
+			auto &token = tokens[t];
+			switch(token.type) {
+			case Token::Type::AnyString:
+				starToken = t++;
+				starName = n;
+				continue;
+			case Token::Type::AnyChar:
+				++t;
+				++n;
+				continue;
+			case Token::Type::Literal:
+				if(token.literal == Normalize(name[n])) {
+					++t;
+					++n;
+					continue;
+				}
+				break;
+			case Token::Type::CharClass:
+				if(m_charClasses[token.charClass].test(static_cast<unsigned char>(name[n]))) {
+					++t;
+					++n;
+					continue;
+				}
+				break;
+			}
+		}
+		if(starToken == std::numeric_limits<size_t>::max())
+			return false;
+		t = starToken + 1;
+		n = ++starName;
+	}
+	while(t < tokens.size() && tokens[t].type == Token::Type::AnyString)
+		++t;
+	return t == tokens.size();
+}
+
+bool pragma::filesystem::Glob::MatchSegments(const Alternative &alternative, size_t segmentIndex, const std::vector<std::string_view> &parts, size_t partIndex) const
+{
+	if(segmentIndex == alternative.size())
+		return partIndex == parts.size();
+	auto &segment = alternative[segmentIndex];
+	if(segment.recursive) {
+		for(auto i = partIndex; i <= parts.size(); ++i) {
+			if(MatchSegments(alternative, segmentIndex + 1, parts, i))
+				return true;
+		}
+		return false;
+	}
+	if(partIndex == parts.size())
+		return false;
+	return MatchSegment(segment, parts[partIndex]) && MatchSegments(alternative, segmentIndex + 1, parts, partIndex + 1);
+}
+
+bool pragma::filesystem::Glob::MatchPrefix(const Alternative &alternative, size_t segmentIndex, const std::vector<std::string_view> &parts, size_t partIndex) const
+{
+	if(segmentIndex == alternative.size())
+		return false;
+	auto &segment = alternative[segmentIndex];
+	if(segment.recursive)
+		return true;
+	if(partIndex == parts.size())
+		return true;
+	return MatchSegment(segment, parts[partIndex]) && MatchPrefix(alternative, segmentIndex + 1, parts, partIndex + 1);
+}
+
+bool pragma::filesystem::Glob::Match(const std::string_view &path) const
+{
+	if(m_matchesAll)
+		return !path.empty() && path.find_first_of("/\\") == std::string_view::npos;
+	// Single segment patterns can be matched against names directly, without splitting the path
+	if(!m_multipleSegments && path.find_first_of("/\\") == std::string_view::npos) {
+		for(auto &alternative : m_alternatives) {
+			if(alternative.empty() ? path.empty() : MatchSegment(alternative.front(), path))
+				return true;
+		}
+		return false;
+	}
+	auto parts = split_path(path);
+	for(auto &alternative : m_alternatives) {
+		if(MatchSegments(alternative, 0, parts, 0))
+			return true;
+	}
+	return false;
+}
+
+bool pragma::filesystem::Glob::CanMatchBelow(const std::string_view &dirPath) const
+{
+	auto parts = split_path(dirPath);
+	for(auto &alternative : m_alternatives) {
+		if(MatchPrefix(alternative, 0, parts, 0))
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,110 @@
+// SPDX-FileCopyrightText: (c) 2026 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#elif _WIN32
+#include <Windows.h>
+#endif
+
+module pragma.filesystem;
+
+import :mapped_file;
+
+#ifdef _WIN32
+std::optional<std::wstring> string_to_wstring(const std::string &str);
+#endif
+
+std::shared_ptr<pragma::filesystem::MappedFile> pragma::filesystem::MappedFile::Open(const std::string &path, std::string *optOutErr)
+{
+	std::shared_ptr<MappedFile> file {new MappedFile {}};
+	file->m_path = path;
+#ifdef __linux__
+	auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd == -1) {
+		if(optOutErr)
+			*optOutErr = std::strerror(errno);
+		return nullptr;
+	}
+	struct stat st;
+	if(::fstat(fd, &st) != 0) {
+		if(optOutErr)
+			*optOutErr = std::strerror(errno);
+		::close(fd);
+		return nullptr;
+	}
+	file->m_size = static_cast<size_t>(st.st_size);
+	if(file->m_size > 0) {
+		auto *data = ::mmap(nullptr, file->m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data == MAP_FAILED) {
+			if(optOutErr)
+				*optOutErr = std::strerror(errno);
+			::close(fd);
+			return nullptr;
+		}
+		file->m_data = static_cast<const uint8_t *>(data);
+	}
+	// The mapping stays valid after the descriptor has been closed
+	::close(fd);
+#elif _WIN32
+	auto wpath = string_to_wstring(path);
+	if(!wpath) {
+		if(optOutErr)
+			*optOutErr = "failed to convert UTF-8 path to UTF-16";
+		return nullptr;
+	}
+	auto hFile = CreateFileW(wpath->c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(hFile == INVALID_HANDLE_VALUE) {
+		if(optOutErr)
+			*optOutErr = "Unable to open file (error " + std::to_string(GetLastError()) + ")";
+		return nullptr;
+	}
+	file->m_fileHandle = hFile;
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(hFile, &size)) {
+		if(optOutErr)
+			*optOutErr = "Unable to determine file size (error " + std::to_string(GetLastError()) + ")";
+		return nullptr;
+	}
+	file->m_size = static_cast<size_t>(size.QuadPart);
+	if(file->m_size > 0) {
+		auto hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if(hMapping == nullptr) {
+			if(optOutErr)
+				*optOutErr = "Unable to create file mapping (error " + std::to_string(GetLastError()) + ")";
+			return nullptr;
+		}
+		file->m_mappingHandle = hMapping;
+		auto *data = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+		if(data == nullptr) {
+			if(optOutErr)
+				*optOutErr = "Unable to map file (error " + std::to_string(GetLastError()) + ")";
+			return nullptr;
+		}
+		file->m_data = static_cast<const uint8_t *>(data);
+	}
+#endif
+	return file;
+}
+
+pragma::filesystem::MappedFile::~MappedFile()
+{
+#ifdef __linux__
+	if(m_data)
+		::munmap(const_cast<uint8_t *>(m_data), m_size);
+#elif _WIN32
+	if(m_data)
+		UnmapViewOfFile(m_data);
+	if(m_mappingHandle)
+		CloseHandle(m_mappingHandle);
+	if(m_fileHandle)
+		CloseHandle(m_fileHandle);
+#endif
+}
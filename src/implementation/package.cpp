@@ -14,3 +14,29 @@ pragma::filesystem::SearchFlags pragma::filesystem::Package::GetSearchFlags() co
 /////////////////
 
 bool pragma::filesystem::PackageManager::HasValue(std::vector<std::string> *values, size_t start, size_t end, std::string val, bool bKeepCase) const { return impl::has_value(values, start, end, val, bKeepCase); }
+
+bool pragma::filesystem::PackageManager::VisitFiles(const std::string &target, const std::string &path, const DirectoryVisitor &visitor, bool includeSize, SearchFlags includeFlags) const
+{
+	std::vector<std::string> files;
+	std::vector<std::string> dirs;
+	FindFiles(target, path, &files, &dirs, false, includeFlags);
+	DirectoryEntry entry {};
+	entry.layer = FileLayer::Package;
+	for(auto &name : files) {
+		entry.name = name;
+		entry.size = {};
+		uint64_t size;
+		if(includeSize && GetSize(path + name, size))
+			entry.size = size;
+		if(!visitor(entry))
+			return false;
+	}
+	entry.directory = true;
+	entry.size = {};
+	for(auto &name : dirs) {
+		entry.name = name;
+		if(!visitor(entry))
+			return false;
+	}
+	return true;
+}
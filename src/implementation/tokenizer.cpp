@@ -0,0 +1,280 @@
+// SPDX-FileCopyrightText: (c) 2026 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.filesystem;
+
+import :file_system;
+import :tokenizer;
+
+static std::array<bool, 256> make_char_table(const std::string_view &chars)
+{
+	std::array<bool, 256> table {};
+	for(auto c : chars)
+		table[static_cast<unsigned char>(c)] = true;
+	return table;
+}
+static const auto g_whitespaceTable = make_char_table(" \t\r\n\v\f");
+static const auto g_newLineTable = make_char_table("\n");
+static const auto g_nullTable = make_char_table(std::string_view {"\0", 1});
+
+pragma::filesystem::FileTokenizer::FileTokenizer(const VFilePtr &f, size_t bufferSize) : m_fileOwner {f}, m_file {*f} { Init(bufferSize); }
+pragma::filesystem::FileTokenizer::FileTokenizer(VFilePtrInternal &f, size_t bufferSize) : m_file {f} { Init(bufferSize); }
+pragma::filesystem::FileTokenizer::~FileTokenizer()
+{
+	auto offset = Tell();
+	if(m_file.Tell() != offset)
+		m_file.Seek(offset);
+}
+
+void pragma::filesystem::FileTokenizer::Init(size_t bufferSize)
+{
+	m_windowOffset = m_file.Tell();
+	auto mem = m_file.GetMemory();
+	if(mem.data() != nullptr) {
+		auto offset = std::min<unsigned long long>(m_windowOffset, mem.size());
+		m_data = reinterpret_cast<const char *>(mem.data()) + offset;
+		m_end = mem.size() - offset;
+		m_zeroCopy = true;
+		m_fileEof = true;
+	}
+	else {
+		bufferSize = std::max(bufferSize, MAX_NUMBER_LENGTH * 2);
+		if(bufferSize <= m_inlineBuffer.size()) {
+			m_buffer = m_inlineBuffer.data();
+			m_bufferSize = m_inlineBuffer.size();
+		}
+		else {
+			m_heapBuffer.resize(bufferSize);
+			m_buffer = m_heapBuffer.data();
+			m_bufferSize = m_heapBuffer.size();
+		}
+		m_data = m_buffer;
+	}
+
+	if(m_file.ShouldRemoveComments()) {
+		m_comments.reserve(m_file.m_comments.size());
+		for(auto &comment : m_file.m_comments)
+			m_comments.push_back({comment.start, comment.end});
+		UpdateCommentTable();
+	}
+}
+
+void pragma::filesystem::FileTokenizer::IgnoreComments(std::string start, std::string end)
+{
+	if(start.empty())
+		return;
+	if(end.empty())
+		end = "\n";
+	m_comments.push_back({std::move(start), std::move(end)});
+	UpdateCommentTable();
+}
+
+void pragma::filesystem::FileTokenizer::UpdateCommentTable()
+{
+	m_commentStarts = {};
+	for(auto &comment : m_comments)
+		m_commentStarts[static_cast<unsigned char>(comment.start.front())] = true;
+}
+
+unsigned long long pragma::filesystem::FileTokenizer::Tell() const { return m_windowOffset + m_pos; }
+
+bool pragma::filesystem::FileTokenizer::Fill()
+{
+	if(m_fileEof)
+		return false;
+	// Everything before the anchor has already been handed out and can be discarded
+	if(m_anchor > 0) {
+		std::memmove(m_buffer, m_buffer + m_anchor, m_end - m_anchor);
+		m_windowOffset += m_anchor;
+		m_pos -= m_anchor;
+		m_end -= m_anchor;
+		m_anchor = 0;
+	}
+	if(m_end == m_bufferSize) {
+		// Token doesn't fit into the buffer
+		if(m_buffer == m_inlineBuffer.data()) {
+			m_heapBuffer.resize(m_bufferSize * 2);
+			std::memcpy(m_heapBuffer.data(), m_buffer, m_end);
+		}
+		else
+			m_heapBuffer.resize(m_bufferSize * 2);
+		m_buffer = m_heapBuffer.data();
+		m_bufferSize = m_heapBuffer.size();
+	}
+	m_data = m_buffer;
+	auto n = m_file.Read(m_buffer + m_end, m_bufferSize - m_end);
+	if(n == 0) {
+		m_fileEof = true;
+		return false;
+	}
+	m_end += n;
+	return true;
+}
+
+bool pragma::filesystem::FileTokenizer::Ensure(size_t n)
+{
+	while(m_end - m_pos < n) {
+		if(!Fill())
+			return false;
+	}
+	return true;
+}
+
+// Checks whether a comment starts at the current position. Unlike SkipComment, this keeps the data before the position.
+bool pragma::filesystem::FileTokenizer::IsCommentStart()
+{
+	for(auto &comment : m_comments) {
+		if(Ensure(comment.start.length()) && std::string_view {m_data + m_pos, comment.start.length()} == comment.start)
+			return true;
+	}
+	return false;
+}
+
+bool pragma::filesystem::FileTokenizer::SkipComment()
+{
+	for(auto &comment : m_comments) {
+		m_anchor = m_pos;
+		if(!Ensure(comment.start.length()) || std::string_view {m_data + m_pos, comment.start.length()} != comment.start)
+			continue;
+		m_pos += comment.start.length();
+		for(;;) {
+			m_anchor = m_pos;
+			if(!Ensure(comment.end.length())) {
+				// Comment isn't terminated
+				m_pos = m_end;
+				return true;
+			}
+			if(std::string_view {m_data + m_pos, comment.end.length()} == comment.end) {
+				m_pos += comment.end.length();
+				return true;
+			}
+			++m_pos;
+		}
+	}
+	return false;
+}
+
+std::string_view pragma::filesystem::FileTokenizer::Scan(const std::array<bool, 256> &stopTable)
+{
+	m_scratch.clear();
+	auto useScratch = false;
+	m_anchor = m_pos;
+	for(;;) {
+		if(m_pos == m_end) {
+			if(!Fill())
+				break;
+			continue;
+		}
+		auto c = static_cast<unsigned char>(m_data[m_pos]);
+		if(m_commentStarts[c] && IsCommentStart()) {
+			// Comments are stripped from the token, which means it can't be returned as a view into the file anymore
+			m_scratch.append(m_data + m_anchor, m_pos - m_anchor);
+			useScratch = true;
+			SkipComment();
+			m_anchor = m_pos;
+			continue;
+		}
+		if(stopTable[c])
+			break;
+		++m_pos;
+	}
+	if(!useScratch)
+		return {m_data + m_anchor, m_pos - m_anchor};
+	m_scratch.append(m_data + m_anchor, m_pos - m_anchor);
+	return m_scratch;
+}
+
+// Returns a mask with the high bit set for every byte of x that is zero
+static constexpr uint64_t zero_byte_mask(uint64_t x)
+{
+	constexpr uint64_t low7 = 0x7F7F7F7F7F7F7F7Full;
+	return ~(((x & low7) + low7) | x | low7);
+}
+static constexpr uint64_t byte_equal_mask(uint64_t x, uint8_t c) { return zero_byte_mask(x ^ (0x0101010101010101ull * c)); }
+
+// Returns the number of leading whitespace characters, testing eight bytes at a time
+static size_t count_leading_whitespace(const char *data, size_t len)
+{
+	constexpr uint64_t highBits = 0x8080808080808080ull;
+	size_t i = 0;
+	for(; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+		uint64_t x;
+		std::memcpy(&x, data + i, sizeof(x));
+		auto mask = byte_equal_mask(x, ' ') | byte_equal_mask(x, '\t') | byte_equal_mask(x, '\n') | byte_equal_mask(x, '\r') | byte_equal_mask(x, '\v') | byte_equal_mask(x, '\f');
+		if(mask == highBits)
+			continue;
+		auto nonWhitespace = ~mask & highBits;
+		if constexpr(std::endian::native == std::endian::little)
+			return i + std::countr_zero(nonWhitespace) / 8;
+		else
+			return i + std::countl_zero(nonWhitespace) / 8;
+	}
+	while(i < len && g_whitespaceTable[static_cast<unsigned char>(data[i])])
+		++i;
+	return i;
+}
+
+void pragma::filesystem::FileTokenizer::SkipWhitespace()
+{
+	for(;;) {
+		m_anchor = m_pos;
+		if(m_pos == m_end && !Fill())
+			return;
+		m_pos += count_leading_whitespace(m_data + m_pos, m_end - m_pos);
+		if(m_pos == m_end)
+			continue;
+		auto c = static_cast<unsigned char>(m_data[m_pos]);
+		if(m_commentStarts[c] && SkipComment())
+			continue;
+		return;
+	}
+}
+
+std::string_view pragma::filesystem::FileTokenizer::PrepareNumber()
+{
+	SkipWhitespace();
+	m_anchor = m_pos;
+	Ensure(MAX_NUMBER_LENGTH);
+	return {m_data + m_pos, m_end - m_pos};
+}
+
+bool pragma::filesystem::FileTokenizer::Eof()
+{
+	m_anchor = m_pos;
+	return m_pos == m_end && !Fill();
+}
+
+std::optional<char> pragma::filesystem::FileTokenizer::Peek()
+{
+	if(Eof())
+		return {};
+	return m_data[m_pos];
+}
+
+std::optional<std::string_view> pragma::filesystem::FileTokenizer::ReadToken()
+{
+	SkipWhitespace();
+	if(Eof())
+		return {};
+	return Scan(g_whitespaceTable);
+}
+
+std::string_view pragma::filesystem::FileTokenizer::ReadUntil(const std::string_view &delimiters) { return Scan(make_char_table(delimiters)); }
+
+std::string_view pragma::filesystem::FileTokenizer::ReadLine()
+{
+	auto line = Scan(g_newLineTable);
+	if(m_pos < m_end && m_data[m_pos] == '\n')
+		++m_pos;
+	return line;
+}
+
+std::string_view pragma::filesystem::FileTokenizer::ReadString()
+{
+	auto str = Scan(g_nullTable);
+	if(m_pos < m_end && m_data[m_pos] == '\0')
+		++m_pos;
+	return str;
+}
@@ -10,20 +10,63 @@ import :case_open;
 #endif
 import :util;
 
+static bool equals_ignore_case(const std::string_view &a, const std::string_view &b)
+{
+	return a.length() == b.length() && std::equal(a.begin(), a.end(), b.begin(), [](char ca, char cb) { return std::tolower(static_cast<unsigned char>(ca)) == std::tolower(static_cast<unsigned char>(cb)); });
+}
+
 bool pragma::filesystem::impl::has_value(std::vector<std::string> *values, size_t start, size_t end, std::string val, bool bKeepCase)
 {
-	if(bKeepCase == false)
-		string::to_lower(val);
 	for(auto i = start; i != end; i++) {
-		std::string valCmp = (*values)[i];
-		if(bKeepCase == false)
-			string::to_lower(valCmp);
-		if(val == valCmp)
+		auto &valCmp = (*values)[i];
+		if(bKeepCase ? (val == valCmp) : equals_ignore_case(val, valCmp))
 			return true;
 	}
 	return false;
 }
 
+bool pragma::filesystem::impl::DuplicateFilter::Add(const std::string_view &name, bool bKeepCase)
+{
+	auto add = [this, &name](auto &set, size_t &count) {
+		// Catch up with the names that have been added in the other comparison mode
+		for(; count < m_names.size(); ++count)
+			set.insert(m_names[count]);
+		if(set.contains(name))
+			return false;
+		set.insert(m_names.emplace_back(name));
+		++count;
+		return true;
+	};
+	return bKeepCase ? add(m_entries, m_entryCount) : add(m_caseInsensitiveEntries, m_caseInsensitiveEntryCount);
+}
+
+pragma::filesystem::impl::FindResultFilter::FindResultFilter(std::vector<std::string> *results, size_t start) : m_results {results}, m_committed {start} {}
+
+void pragma::filesystem::impl::FindResultFilter::ExcludeExisting(bool bKeepCase)
+{
+	if(m_results == nullptr)
+		return;
+	for(size_t i = 0; i < m_committed; ++i)
+		m_filter.Add((*m_results)[i], bKeepCase);
+}
+
+void pragma::filesystem::impl::FindResultFilter::Commit(bool bKeepCase)
+{
+	if(m_results == nullptr)
+		return;
+	auto &results = *m_results;
+	auto n = m_committed;
+	for(auto i = m_committed; i < results.size(); ++i) {
+		if(!m_filter.Add(results[i], bKeepCase))
+			continue;
+		if(n != i)
+			results[n] = std::move(results[i]);
+		++n;
+	}
+	results.resize(n);
+	m_committed = n;
+}
+
 void pragma::filesystem::impl::to_case_sensitive_path(std::string &inOutCaseInsensitivePath)
 {
 #ifdef __linux__
@@ -0,0 +1,280 @@
+// SPDX-FileCopyrightText: (c) 2026 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+export module pragma.filesystem:archive;
+
+export import :file_system;
+export import :glob;
+export import :mapped_file;
+export import :package;
+
+export namespace pragma::filesystem {
+#pragma warning(push)
+#pragma warning(disable : 4251)
+	enum class ArchiveCompression : uint8_t { None = 0, Lzma, Bz2 };
+
+	// On-disk layout of archive files. All values are little-endian.
+	// [Header][Entry data][TOC: EntryRecord * entryCount][String table]
+	// The TOC is sorted by path hash, so it can be searched directly from the mapped file.
+	namespace archive {
+		constexpr std::array<char, 4> MAGIC {'V', 'F', 'A', 'R'};
+		constexpr uint32_t VERSION = 1;
+		constexpr uint32_t DEFAULT_ALIGNMENT = 16;
+		constexpr uint32_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+		// EntryRecord::flags
+		constexpr uint8_t ENTRY_FLAG_CHUNKED = 1;
+
+		struct Header {
+			std::array<char, 4> magic;
+			uint32_t version;
+			uint32_t entryCount;
+			// CRC32 of the TOC followed by the string table
+			uint32_t tocCrc;
+			uint64_t tocOffset;
+			uint64_t stringTableOffset;
+			uint64_t stringTableSize;
+			uint64_t reserved;
+		};
+		static_assert(sizeof(Header) == 48);
+
+		struct EntryRecord {
+			uint64_t pathHash;
+			uint64_t dataOffset;
+			// Size of the data in the archive
+			uint64_t storedSize;
+			// Size after decompression
+			uint64_t size;
+			uint32_t pathOffset;
+			uint32_t pathLength;
+			// CRC32 of the uncompressed data
+			uint32_t crc;
+			ArchiveCompression compression;
+			uint8_t flags;
+			uint16_t reserved;
+		};
+		static_assert(sizeof(EntryRecord) == 48);
+
+		// The data of chunked entries starts with a ChunkTable, followed by chunkCount ChunkRecords and the chunk data.
+		// All chunks except for the last one contain chunkSize bytes of uncompressed data and can be decompressed independently.
+		struct ChunkTable {
+			uint32_t chunkSize;
+			uint32_t chunkCount;
+		};
+		struct ChunkRecord {
+			// Relative to the start of the entry data
+			uint64_t offset;
+			// Chunks that are stored with their uncompressed size are not compressed
+			uint32_t storedSize;
+			// CRC32 of the uncompressed chunk
+			uint32_t crc;
+		};
+		static_assert(sizeof(ChunkTable) == 8 && sizeof(ChunkRecord) == 16);
+
+		// Case-insensitive 64-bit FNV-1a hash. Both '/' and '\\' are treated as '/'.
+		DLLFSYSTEM uint64_t hash_path(const std::string_view &path);
+		DLLFSYSTEM uint32_t crc32(std::span<const uint8_t> data, uint32_t crc = 0);
+	};
+
+	class DLLFSYSTEM ArchivePackage : public Package {
+	  public:
+		// Expects an absolute system path
+		static std::unique_ptr<ArchivePackage> Open(const std::string &path, SearchFlags searchFlags = SearchFlags::Local, std::string *optOutErr = nullptr);
+		virtual ~ArchivePackage() override;
+		const std::string &GetPath() const { return m_path; }
+		// Unique for every opened archive, identifies its blocks in the ArchiveBlockCache
+		uint64_t GetId() const { return m_id; }
+		std::span<const archive::EntryRecord> GetEntries() const { return m_entries; }
+		std::string_view GetEntryPath(const archive::EntryRecord &entry) const;
+		// Paths are matched case-insensitively
+		const archive::EntryRecord *FindEntry(const std::string_view &path) const;
+		bool IsDirectory(const std::string_view &path) const;
+		// Returns nullptr if the entry is damaged. Uncompressed entries point directly into the mapped file.
+		// Chunked entries are decompressed entirely, OpenFile should be used to read them partially.
+		std::shared_ptr<const VFileStorage> OpenEntry(const archive::EntryRecord &entry, std::string *optOutErr = nullptr) const;
+		VFilePtr OpenFile(const std::string_view &path, bool bBinary) const;
+		// Appends the matching children of the directory. Duplicates from other sources are not filtered.
+		void FindFiles(const std::string_view &path, const Glob &glob, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, bool bKeepPath) const;
+		// Same as FindFiles, but reports the children to the visitor. Returns false if the visitor stopped the enumeration.
+		bool VisitFiles(const std::string_view &path, const Glob &glob, const DirectoryVisitor &visitor, bool includeSize) const;
+		// Checks the checksums of all entries
+		bool Verify(std::string *optOutErr = nullptr) const;
+		// Uncompressed entries are only checked by Verify by default, since that requires reading all of their data
+		void SetVerifyUncompressedEntries(bool verify) { m_verifyUncompressed = verify; }
+	  private:
+		struct Child {
+			std::string_view name;
+			bool directory;
+			// nullptr for directories
+			const archive::EntryRecord *entry;
+		};
+		ArchivePackage(SearchFlags searchFlags);
+		void BuildDirectoryIndex() const;
+		std::string m_path;
+		uint64_t m_id = 0;
+		std::shared_ptr<MappedFile> m_file;
+		std::span<const archive::EntryRecord> m_entries;
+		std::string_view m_stringTable;
+		bool m_verifyUncompressed = false;
+		// Only built once it is needed by FindFiles or IsDirectory
+		mutable std::once_flag m_directoryIndexBuilt;
+		mutable std::unordered_map<std::string, std::vector<Child>, detail::CaseInsensitiveHash, detail::CaseInsensitiveEqual> m_directoryIndex;
+	};
+
+	// Process-wide LRU cache of decompressed chunks, shared by all readers of compressed archive entries.
+	// Entries that aren't chunked are cached as a whole, as chunk 0.
+	// The cache is split into shards with their own lock, each shard gets an equal part of the memory budget.
+	class DLLFSYSTEM ArchiveBlockCache {
+	  public:
+		static constexpr uint64_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+		struct Key {
+			// See ArchivePackage::GetId
+			uint64_t archive;
+			uint32_t entry;
+			uint32_t chunk;
+			bool operator==(const Key &) const = default;
+		};
+		struct Statistics {
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t evictions = 0;
+			uint64_t blockCount = 0;
+			uint64_t memoryUsage = 0;
+		};
+		using Block = std::shared_ptr<const std::vector<uint8_t>>;
+		// 0 disables the cache
+		static void SetMemoryBudget(uint64_t budget);
+		static uint64_t GetMemoryBudget();
+		static Block Find(const Key &key);
+		// Blocks that are larger than the budget of a shard are not cached
+		static void Insert(const Key &key, const Block &block);
+		// Removes all blocks of the specified archive
+		static void Remove(uint64_t archive);
+		static void Clear();
+		static Statistics GetStatistics();
+		static void ResetStatistics();
+	};
+
+	// Reads a chunked archive entry. Only the chunks that are touched by Read are decompressed, the most recent one is kept in memory.
+	class DLLFSYSTEM VFilePtrInternalChunked : public VFilePtrInternal {
+	  public:
+		// data is the stored data of the entry and has to stay valid for as long as keepAlive exists.
+		// Decompressed chunks are shared through the ArchiveBlockCache under cacheId and entryIndex, unless cacheId is 0.
+		// Returns nullptr if the chunk table is invalid.
+		static std::shared_ptr<VFilePtrInternalChunked> Create(std::span<const uint8_t> data, std::shared_ptr<const void> keepAlive, ArchiveCompression compression, uint64_t size, uint64_t cacheId = 0, uint32_t entryIndex = 0);
+		virtual ~VFilePtrInternalChunked() override;
+		size_t Read(void *ptr, size_t size) override;
+		unsigned long long Tell() override;
+		virtual void Seek(unsigned long long offset) override;
+		using VFilePtrInternal::Seek;
+		int Eof() override;
+		int ReadChar() override;
+		unsigned long long GetSize() override;
+		uint32_t GetChunkSize() const { return m_chunkSize; }
+		uint32_t GetChunkCount() const { return m_chunkCount; }
+	  private:
+		static constexpr uint32_t INVALID_CHUNK = std::numeric_limits<uint32_t>::max();
+		VFilePtrInternalChunked() = default;
+		bool LoadChunk(uint32_t index);
+		std::span<const uint8_t> m_data;
+		std::shared_ptr<const void> m_keepAlive;
+		ArchiveCompression m_compression = ArchiveCompression::None;
+		unsigned long long m_size = 0;
+		unsigned long long m_offset = 0;
+		uint32_t m_chunkSize = 0;
+		uint32_t m_chunkCount = 0;
+		uint32_t m_currentChunk = INVALID_CHUNK;
+		// Uncompressed chunks whose checksum has already been checked by this handle
+		std::vector<bool> m_verifiedChunks;
+		uint64_t m_cacheId = 0;
+		uint32_t m_entryIndex = 0;
+		// Points into m_block, or directly into m_data for uncompressed chunks
+		std::span<const uint8_t> m_chunk;
+		ArchiveBlockCache::Block m_block;
+	};
+
+	// PackageManager for archives written by ArchiveWriter. Packages are searched in the order in which they were loaded.
+	class DLLFSYSTEM ArchivePackageManager : public PackageManager {
+	  public:
+		ArchivePackageManager() = default;
+		virtual Package *LoadPackage(std::string package, SearchFlags searchMode = SearchFlags::Local) override;
+		virtual void ClearPackages(SearchFlags searchMode) override;
+		virtual void FindFiles(const std::string &target, const std::string &path, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, bool bKeepPath, SearchFlags includeFlags) const override;
+		virtual bool GetSize(const std::string &name, uint64_t &size) const override;
+		virtual bool Exists(const std::string &name, SearchFlags includeFlags) const override;
+		virtual bool GetFileFlags(const std::string &name, SearchFlags includeFlags, FVFile &flags) const override;
+		virtual VFilePtr OpenFile(const std::string &path, bool bBinary, SearchFlags includeFlags, SearchFlags excludeFlags) const override;
+		virtual bool EnumerateFiles(const std::function<void(const EntryInfo &)> &callback) const override;
+		virtual bool VisitFiles(const std::string &target, const std::string &path, const DirectoryVisitor &visitor, bool includeSize, SearchFlags includeFlags) const override;
+		const std::vector<std::unique_ptr<ArchivePackage>> &GetPackages() const { return m_packages; }
+	  private:
+		std::pair<const ArchivePackage *, const archive::EntryRecord *> FindEntry(const std::string &path, SearchFlags includeFlags) const;
+		std::vector<std::unique_ptr<ArchivePackage>> m_packages;
+	};
+
+	// Builds archives that can be loaded with ArchivePackageManager.
+	// File contents are added as blobs, multiple entries can refer to the same blob.
+	class DLLFSYSTEM ArchiveWriter {
+	  public:
+		static constexpr size_t INVALID_BLOB = std::numeric_limits<size_t>::max();
+		// Returns nullptr if the data couldn't be loaded
+		using Source = std::function<std::shared_ptr<const std::vector<uint8_t>>()>;
+		ArchiveWriter() = default;
+		// Compressed blobs are stored uncompressed if compression doesn't reduce their size.
+		// If chunkSize is not 0, compressed blobs larger than chunkSize are split into independently compressed chunks,
+		// which allows seeking within the file without decompressing all of it (see VFilePtrInternalChunked).
+		size_t AddBlob(std::shared_ptr<const std::vector<uint8_t>> data, ArchiveCompression compression = ArchiveCompression::Lzma, uint32_t chunkSize = 0);
+		// The source is only invoked while the archive is written, and may be invoked from a worker thread.
+		// This avoids having to keep the contents of all files in memory at once.
+		size_t AddBlob(Source source, ArchiveCompression compression = ArchiveCompression::Lzma, uint32_t chunkSize = 0);
+		// Returns false if an entry with the same path already exists
+		bool AddEntry(std::string path, size_t blobIndex);
+		// Same as AddBlob followed by AddEntry. Returns the blob index or INVALID_BLOB.
+		size_t AddFile(std::string path, std::shared_ptr<const std::vector<uint8_t>> data, ArchiveCompression compression = ArchiveCompression::Lzma, uint32_t chunkSize = 0);
+		// Alignment of uncompressed blobs in the archive, so they can be used directly from the mapped file
+		void SetAlignment(uint32_t alignment) { m_alignment = std::max<uint32_t>(alignment, 1); }
+		// LZMA preset (0-9) or bzip2 block size (1-9)
+		void SetCompressionLevel(uint32_t level) { m_compressionLevel = level; }
+		// Number of threads used to compress blobs. 0 uses all hardware threads.
+		void SetThreadCount(uint32_t count) { m_threadCount = count; }
+		size_t GetBlobCount() const { return m_blobs.size(); }
+		size_t GetEntryCount() const { return m_entries.size(); }
+		// Expects an absolute system path. Blobs are written in the order in which they were added.
+		bool Write(const std::string &path, std::string *optOutErr = nullptr) const;
+	  private:
+		struct EncodedBlob;
+		std::optional<EncodedBlob> EncodeBlob(size_t index) const;
+		struct Blob {
+			Source source;
+			ArchiveCompression compression;
+			uint32_t chunkSize;
+		};
+		struct Entry {
+			std::string path;
+			size_t blob;
+		};
+		std::vector<Blob> m_blobs;
+		std::vector<Entry> m_entries;
+		std::unordered_set<std::string, detail::CaseInsensitiveHash, detail::CaseInsensitiveEqual> m_entryPaths;
+		uint32_t m_alignment = archive::DEFAULT_ALIGNMENT;
+		uint32_t m_compressionLevel = 6;
+		uint32_t m_threadCount = 1;
+	};
+#pragma warning(pop)
+}
+
+namespace pragma::filesystem::archive {
+	// Returns an empty optional if compression failed
+	std::optional<std::vector<uint8_t>> compress(ArchiveCompression compression, std::span<const uint8_t> data, uint32_t level);
+	// out must have the exact size of the uncompressed data
+	bool decompress(ArchiveCompression compression, std::span<const uint8_t> data, std::span<uint8_t> out);
+
+	// Returns the chunk table, records and chunk data of a chunked entry, or an empty optional if chunking doesn't reduce the size
+	std::optional<std::vector<uint8_t>> compress_chunked(ArchiveCompression compression, std::span<const uint8_t> data, uint32_t chunkSize, uint32_t level);
+	// Validates the chunk table against the stored data and the uncompressed size of the entry
+	bool read_chunk_table(std::span<const uint8_t> data, uint64_t size, ChunkTable &outTable);
+	ChunkRecord get_chunk_record(std::span<const uint8_t> data, uint32_t index);
+	// out must have the exact size of the uncompressed chunk
+	bool decompress_chunk(ArchiveCompression compression, std::span<const uint8_t> data, const ChunkRecord &record, std::span<uint8_t> out);
+}
@@ -37,6 +37,8 @@ export namespace pragma::filesystem {
 			WatchDirectoryChanges = StartDisabled << 1u,
 		};
 
+		static constexpr std::chrono::milliseconds DEFAULT_DEBOUNCE_WINDOW {100};
+
 		DirectoryWatcher(const std::string &path, WatchFlags flags = WatchFlags::None, DirectoryWatcherManager *watcherManager = nullptr);
 		virtual ~DirectoryWatcher();
 		uint32_t Poll();
@@ -44,11 +46,17 @@ export namespace pragma::filesystem {
 
 		void SetEnabled(bool enabled);
 		bool IsEnabled() const;
+
+		// Events are relayed once this much time has passed since the first event for the file.
+		// Further events for the same file within that window are merged with it, e.g. Add followed by Modified is reported as Add.
+		void SetDebounceWindow(std::chrono::milliseconds window);
+		std::chrono::milliseconds GetDebounceWindow() const { return m_debounceWindow; }
 	  protected:
 		void UpdateEnabledState();
 		virtual void OnFileModified(const std::string &fName, FileWatcherEvent event) = 0;
 	  private:
 		bool m_enabled = true;
+		std::chrono::milliseconds m_debounceWindow = DEFAULT_DEBOUNCE_WINDOW;
 		std::string m_path;
 		WatchFlags m_watchFlags;
 		std::unique_ptr<DirectoryWatchListenerSet> m_watchListenerSet;
@@ -34,4 +34,9 @@ export {
 		using namespace pragma::math::scoped_enum::bitwise;
 	};
 	REGISTER_ENUM_FLAGS(pragma::filesystem::SearchFlags)
+
+	namespace pragma::filesystem {
+		// Source of an entry reported by visit_files
+		enum class FileLayer : uint8_t { Virtual = 0, Package, Root, Mount };
+	};
 }
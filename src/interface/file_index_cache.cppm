@@ -4,6 +4,7 @@
 export module pragma.filesystem:file_index_cache;
 
 export import pragma.util;
+export import :glob;
 
 export {
 	namespace pragma::filesystem {
@@ -35,8 +36,25 @@ export {
 			void Remove(const std::string_view &path);
 			const std::string &GetRootPath() const { return m_rootPath; }
 			const std::unordered_map<size_t, ItemInfo> &GetIndexCache() const { return m_indexCache; };
+
+			// Optionally keeps the paths in a sorted index and a per-extension index, which are required for FindFilesByExtension and FindItems.
+			// Since the primary index only stores hashes, enabling it re-scans the root path.
+			void SetSecondaryIndexEnabled(bool enabled);
+			bool IsSecondaryIndexEnabled() const { return m_secondaryIndexEnabled; }
+			// Returns the paths of all files with the extension (without the dot) in the directory and its sub-directories.
+			// Paths are relative to the root path and use '/' as separator.
+			std::vector<std::string> FindFilesByExtension(const std::string_view &extension, const std::string_view &dir = {}) const;
+			// Returns the paths of all items that match the pattern. Only the range of the literal prefix of the pattern is scanned.
+			// Type::Invalid matches both files and directories.
+			std::vector<std::string> FindItems(const Glob &glob, Type type = Type::Invalid) const;
 		  private:
+			struct PathLess {
+				using is_transparent = void;
+				bool operator()(const std::string_view &a, const std::string_view &b) const;
+			};
 			void NormalizePath(std::string &path) const;
+			void AddToSecondaryIndex(const std::string_view &path, Type type);
+			void RemoveFromSecondaryIndex(const std::string_view &path);
 			size_t Hash(const std::string_view &key, bool isAbsolutePath) const;
 			void QueuePath(size_t rootLen, const std::filesystem::directory_entry &path);
 			void IterateFiles(size_t rootLen, const std::filesystem::directory_entry &path);
@@ -47,6 +65,12 @@ export {
 			std::condition_variable m_taskCompleteCondition;
 			std::mutex m_taskCompletedMutex;
 
+			std::atomic<bool> m_secondaryIndexEnabled = false;
+			// Separators are normalized to '/', the case is kept. Ordered case-insensitively, so every directory is a contiguous range.
+			std::map<std::string, Type, PathLess> m_sortedPaths;
+			// Lower-case extension -> file paths, pointing into the keys of m_sortedPaths
+			std::unordered_map<std::string, std::set<std::string_view, PathLess>> m_extensionIndex;
+
 			std::string m_rootPath;
 			BS::light_thread_pool m_pool;
 			bool m_caseSensitive = false;
@@ -76,9 +100,17 @@ export {
 			bool Exists(std::string path) const;
 			void Add(const std::string_view &path, FileIndexCache::Type type);
 			void Remove(const std::string_view &path);
+
+			// Applies to all caches, including ones that are added later
+			void SetSecondaryIndexEnabled(bool enabled);
+			bool IsSecondaryIndexEnabled() const { return m_secondaryIndexEnabled; }
+			// Combined results of all caches, paths that exist in multiple caches are only included once
+			std::vector<std::string> FindFilesByExtension(const std::string_view &extension, const std::string_view &dir = {}) const;
+			std::vector<std::string> FindItems(const Glob &glob, FileIndexCache::Type type = FileIndexCache::Type::Invalid) const;
 		  private:
 			std::unordered_map<std::string, std::unique_ptr<FileIndexCache>> m_caches;
 			FileIndexCache *m_primaryCache = nullptr;
+			bool m_secondaryIndexEnabled = false;
 		};
 	};
 }
@@ -9,55 +9,330 @@ export module pragma.filesystem:file_system;
 
 export import :enums;
 export import :file_handle;
+export import :mapped_file;
+export import :tokenizer;
 export import pragma.util;
 import pragma.math;
 
 export namespace pragma::filesystem {
 #pragma warning(push)
 #pragma warning(disable : 4251)
+	namespace detail {
+		// ASCII case-insensitive hash and comparison for heterogeneous lookups with std::string_view
+		struct DLLFSYSTEM CaseInsensitiveHash {
+			using is_transparent = void;
+			size_t operator()(const std::string_view &str) const;
+		};
+		struct DLLFSYSTEM CaseInsensitiveEqual {
+			using is_transparent = void;
+			bool operator()(const std::string_view &a, const std::string_view &b) const;
+		};
+	};
+
+	struct DirectoryEntry {
+		// Only valid for the duration of the visitor call
+		std::string_view name;
+		FileLayer layer = FileLayer::Root;
+		bool directory = false;
+		// Only set for local files
+		bool symbolicLink = false;
+		// Only set for files, if the size was requested and is known
+		std::optional<uint64_t> size {};
+	};
+	// Result of get_file_info and stat_many
+	struct FileInfo {
+		// FVFile::Invalid if the file doesn't exist
+		FVFile flags = FVFile::Invalid;
+		// Local files found through the file index without details are always reported as FileLayer::Root, see FileManager::GetFileInfos
+		FileLayer layer = FileLayer::Root;
+		// Always 0 for directories
+		uint64_t size = 0;
+		// Only known for local files
+		std::optional<std::filesystem::file_time_type> lastWriteTime {};
+		std::filesystem::perms permissions = std::filesystem::perms::unknown;
+		bool Exists() const { return !pragma::math::is_flag_set(flags, FVFile::Invalid); }
+	};
+	// Returning false stops the enumeration
+	using DirectoryVisitor = std::function<bool(const DirectoryEntry &)>;
+
+	struct WalkOptions {
+		// Maximum depth of the reported entries, 0 only reports the direct children of the path. Unlimited if not set.
+		std::optional<uint32_t> maxDepth {};
+		// Glob pattern, see Glob. Without separators only the names of the entries are matched and directories are descended into regardless,
+		// otherwise the path relative to the walked directory is matched (e.g. "**/*.txt") and directories that can't contain matches are skipped.
+		std::string filter = "*";
+		// Symbolic links to directories are only descended into if enabled. Links to a directory that has already been visited (including ancestors) are skipped.
+		bool followSymlinks = false;
+		bool includeSize = false;
+		SearchFlags includeFlags = SearchFlags::All;
+		SearchFlags excludeFlags = SearchFlags::None;
+		// 0 uses all hardware threads
+		uint32_t threadCount = 0;
+	};
+	// path is the path of the entry, including the path that was passed to walk_directory.
+	// May be called from multiple threads at once. Returning false stops the walk.
+	using WalkVisitor = std::function<bool(const std::string &path, const DirectoryEntry &entry)>;
+
+	class VirtualArena;
+	class FileManager;
 	class DLLFSYSTEM VData {
-	  private:
-		std::string m_name;
 	  public:
+		// Name that is owned by a VirtualArena
+		struct InternedName {
+			std::string_view name;
+		};
 		VData(std::string name);
+		VData(InternedName name);
+		VData(const VData &) = delete;
+		VData &operator=(const VData &) = delete;
+		virtual ~VData() = default;
 		virtual bool IsFile();
 		virtual bool IsDirectory();
-		std::string GetName();
+		std::string_view GetName() const;
+		// Returns the arena this node was allocated in, or nullptr if it was allocated with new
+		VirtualArena *GetArena() const;
+	  private:
+		friend VirtualArena;
+		std::string m_ownedName;
+		std::string_view m_name;
+		VirtualArena *m_arena = nullptr;
+		size_t m_arenaIndex = 0;
 	};
 
 #undef CopyFile
 #undef MoveFile
 
-	class DLLFSYSTEM VFile : public VData {
+	// Backing memory of a virtual file
+	class DLLFSYSTEM VFileStorage {
+	  public:
+		struct Mapping {
+			std::span<const uint8_t> data;
+			// The data stays valid for as long as this is held
+			std::shared_ptr<const void> keepAlive;
+		};
+		virtual ~VFileStorage() = default;
+		virtual unsigned long long GetSize() const = 0;
+		virtual Mapping Map() const = 0;
+		// Returns the underlying vector if the storage is vector-backed, otherwise nullptr
+		virtual std::shared_ptr<std::vector<uint8_t>> GetVector() const { return nullptr; }
+	};
+
+	// The vector must not be modified anymore once it has been handed to the storage, open handles read from it directly
+	class DLLFSYSTEM VFileVectorStorage : public VFileStorage {
+	  public:
+		VFileVectorStorage(const std::shared_ptr<std::vector<uint8_t>> &data);
+		unsigned long long GetSize() const override;
+		Mapping Map() const override;
+		std::shared_ptr<std::vector<uint8_t>> GetVector() const override;
 	  private:
 		std::shared_ptr<std::vector<uint8_t>> m_data;
+	};
+
+	// Memory that is owned elsewhere, e.g. a static blob or a region of a loaded archive.
+	// If keepAlive is nullptr, the memory must outlive the storage and all handles to it.
+	class DLLFSYSTEM VFileSpanStorage : public VFileStorage {
+	  public:
+		VFileSpanStorage(std::span<const uint8_t> data, const std::shared_ptr<const void> &keepAlive = nullptr);
+		unsigned long long GetSize() const override;
+		Mapping Map() const override;
+	  private:
+		std::span<const uint8_t> m_data;
+		std::shared_ptr<const void> m_keepAlive;
+	};
+
+	class DLLFSYSTEM VFileMappedStorage : public VFileStorage {
+	  public:
+		// Maps the file at the absolute system path. If size is std::numeric_limits<size_t>::max(), everything after the offset is used.
+		static std::shared_ptr<VFileMappedStorage> Create(const std::string &path, size_t offset = 0, size_t size = std::numeric_limits<size_t>::max(), std::string *optOutErr = nullptr);
+		VFileMappedStorage(const std::shared_ptr<MappedFile> &file, size_t offset = 0, size_t size = std::numeric_limits<size_t>::max());
+		unsigned long long GetSize() const override;
+		Mapping Map() const override;
+		const std::shared_ptr<MappedFile> &GetMappedFile() const { return m_file; }
+	  private:
+		std::shared_ptr<MappedFile> m_file;
+		std::span<const uint8_t> m_data;
+	};
+
+	// Contents are produced by a callback on first access and cached afterwards.
+	// The cached contents of all generated files share a memory budget; the least recently used ones are released when it is exceeded
+	// and produced again on the next access.
+	class DLLFSYSTEM VFileGeneratorStorage : public VFileStorage {
+	  public:
+		using Generator = std::function<std::vector<uint8_t>()>;
+		// 0 means unlimited
+		static void SetMemoryBudget(uint64_t budget);
+		static uint64_t GetMemoryBudget();
+		static uint64_t GetMemoryUsage();
+
+		// If a size hint is specified, it is returned by GetSize until the contents have been generated. Otherwise GetSize generates the contents.
+		VFileGeneratorStorage(Generator generator, std::optional<unsigned long long> sizeHint = {});
+		virtual ~VFileGeneratorStorage() override;
+		unsigned long long GetSize() const override;
+		Mapping Map() const override;
+		bool IsGenerated() const;
+		// Releases the cached contents
+		void Release() const;
+
+		struct Slot;
+	  private:
+		Generator m_generator;
+		std::optional<unsigned long long> m_sizeHint;
+		std::shared_ptr<Slot> m_slot;
+	};
+
+	class DLLFSYSTEM VFile : public VData {
+	  private:
+		friend FileManager;
+		std::shared_ptr<const VFileStorage> m_storage;
 	  public:
 		VFile(const std::string &name, const std::shared_ptr<std::vector<uint8_t>> &data);
+		VFile(InternedName name, const std::shared_ptr<std::vector<uint8_t>> &data);
+		VFile(const std::string &name, const std::shared_ptr<const VFileStorage> &storage);
+		VFile(InternedName name, const std::shared_ptr<const VFileStorage> &storage);
 		bool IsFile();
 		unsigned long long GetSize();
+		// Returns the contents if the file is vector-backed, otherwise nullptr. Use Map to access the contents of any storage.
 		std::shared_ptr<std::vector<uint8_t>> GetData() const;
+		VFileStorage::Mapping Map() const;
+		const std::shared_ptr<const VFileStorage> &GetStorage() const;
 	};
 
 	class DLLFSYSTEM VDirectory : public VData {
 	  private:
 		std::vector<VData *> m_files;
+		// Children by name, used for lookups. The keys point into the names of the child nodes.
+		std::unordered_map<std::string_view, VFile *, detail::CaseInsensitiveHash, detail::CaseInsensitiveEqual> m_fileIndex;
+		std::unordered_map<std::string_view, VDirectory *, detail::CaseInsensitiveHash, detail::CaseInsensitiveEqual> m_directoryIndex;
+		// Arena for sub-directories created by AddDirectory. If nullptr, they're allocated with new.
+		VirtualArena *m_childArena = nullptr;
+		VData *Find(std::string_view path, bool file);
+		// If lowerCase is set, the name is compared as if it was lowercased
+		VDirectory *FindDirectory(std::string_view name, bool lowerCase = false);
+		void DestroyChild(VData *file);
 	  public:
 		VDirectory(std::string name);
+		VDirectory(VirtualArena &childArena);
+		VDirectory(InternedName name, VirtualArena &childArena);
 		VDirectory();
 		~VDirectory();
-		std::vector<VData *> &GetFiles();
-		VFile *GetFile(std::string path);
-		VDirectory *GetDirectory(std::string path);
+		// Use Add and Remove to modify the children of this directory
+		const std::vector<VData *> &GetFiles() const;
+		// The path is lowercased, so the directories on the path have to have lowercase names. The file name is compared case-insensitively.
+		VFile *GetFile(const std::string_view &path);
+		// Directory names have to match exactly
+		VDirectory *GetDirectory(const std::string_view &path);
 		bool IsDirectory();
 		void Add(VData *file);
 		void Remove(VData *file);
-		VDirectory *AddDirectory(std::string name);
+		// Destroys all children
+		void Clear();
+		VDirectory *AddDirectory(const std::string_view &name);
+	};
+
+	// Bump allocator for virtual file nodes and their names.
+	// Destroyed nodes put their memory and slot on a free list, which new nodes of the same size and alignment reuse.
+	// Interned names are shared rather than freed, and everything is returned to the system when the arena is cleared.
+	class DLLFSYSTEM VirtualArena {
+	  public:
+		VirtualArena();
+		~VirtualArena();
+		VirtualArena(const VirtualArena &) = delete;
+		VirtualArena &operator=(const VirtualArena &) = delete;
+		template<class T, typename... TArgs>
+		    requires(std::is_base_of_v<VData, T>)
+		T *Create(TArgs &&...args)
+		{
+			auto *memory = Allocate(sizeof(T), alignof(T));
+			auto *node = std::construct_at(static_cast<T *>(memory), std::forward<TArgs>(args)...);
+			Register(*node, {node, memory, sizeof(T), alignof(T)});
+			return node;
+		}
+		// Returns a copy of the string that lives until the arena is cleared. Identical strings share the same copy.
+		std::string_view Intern(const std::string_view &str);
+		void Destroy(VData &node);
+		// Destroys all remaining nodes and releases all memory at once
+		void Clear();
+		size_t GetNodeCount() const { return m_nodeCount; }
+	  private:
+		struct Slot {
+			VData *node = nullptr;
+			void *memory = nullptr;
+			size_t size = 0;
+			size_t alignment = 0;
+		};
+		void *Allocate(size_t size, size_t alignment);
+		void Register(VData &node, const Slot &slot);
+		std::pmr::monotonic_buffer_resource m_resource;
+		std::optional<std::pmr::unordered_set<std::string_view>> m_names;
+		std::vector<Slot> m_nodes;
+		// Indices of unused slots in m_nodes
+		std::vector<size_t> m_freeSlots;
+		// Memory of destroyed nodes by {size, alignment}, which is reused for new nodes of the same type
+		std::map<std::pair<size_t, size_t>, std::vector<void *>> m_freeBlocks;
+		size_t m_nodeCount = 0;
+	};
+
+	// Immutable copy of the virtual file tree.
+	// Snapshots are published atomically whenever the virtual files change and can be read from any thread without locking.
+	// Entries are shared between snapshots, a change only copies the entries along its path.
+	class DLLFSYSTEM VirtualSnapshot {
+	  public:
+		struct Entry;
+		struct Child {
+			// Points into the name of the entry
+			std::string_view name;
+			std::shared_ptr<const Entry> entry;
+		};
+		// A file and a directory can share the same path, in which case both flags are set
+		struct Entry {
+			std::string name;
+			bool file = false;
+			bool directory = false;
+			std::shared_ptr<const VFileStorage> storage;
+			// Sorted by name, case-insensitively
+			std::vector<Child> children;
+		};
+		VirtualSnapshot();
+		// Paths are matched case-insensitively. The root directory can only be retrieved with GetRoot.
+		const Entry *Find(const std::string_view &path) const;
+		const Entry &GetRoot() const;
+	  private:
+		friend FileManager;
+		static std::shared_ptr<const VirtualSnapshot> Build(VDirectory &root);
+		static void Build(VDirectory &dir, Entry &dirEntry);
+		// Returns a copy of this snapshot in which the file at the path has the specified storage, or is removed if storage is nullptr.
+		// Returns nullptr if nothing has changed.
+		std::shared_ptr<const VirtualSnapshot> SetFile(const std::string_view &path, const std::shared_ptr<const VFileStorage> &storage) const;
+		static std::shared_ptr<const Entry> SetFile(const Entry &dir, std::span<const std::string_view> components, const std::shared_ptr<const VFileStorage> &storage);
+		// Returns a copy of this snapshot with all of the files added. Every affected entry is rebuilt only once.
+		std::shared_ptr<const VirtualSnapshot> AddFiles(std::span<const std::pair<std::string_view, std::shared_ptr<const VFileStorage>>> files) const;
+		struct FileUpdate {
+			std::span<const std::string_view> components;
+			std::shared_ptr<const VFileStorage> storage;
+		};
+		// The files have to be sorted by their components and share the first depth components, which lead to the entry
+		static std::shared_ptr<const Entry> AddFiles(const Entry *existing, const std::string_view &name, std::span<const FileUpdate> files, size_t depth);
+		std::shared_ptr<const Entry> m_root;
+	};
+
+	// Collects virtual files and adds them all at once, publishing a single new snapshot
+	class DLLFSYSTEM VirtualFileBatch {
+	  public:
+		void Add(std::string path, const std::shared_ptr<std::vector<uint8_t>> &data);
+		void Add(std::string path, const std::shared_ptr<const VFileStorage> &storage);
+		void Commit();
+		size_t GetSize() const { return m_files.size(); }
+	  private:
+		std::vector<std::pair<std::string, std::shared_ptr<const VFileStorage>>> m_files;
 	};
 
 	class DLLFSYSTEM FileManager;
+	class ArchivePackage;
 	class DLLFSYSTEM VFilePtrInternal {
 	  public:
 		friend FileManager;
+		friend FileTokenizer;
+		friend ArchivePackage;
 	  private:
 		struct Comment {
 			Comment(std::string cmt) : Comment(cmt, "\n") {}
@@ -71,8 +346,11 @@ export namespace pragma::filesystem {
 		EVFile m_type;
 		bool m_bRead;
 		bool m_bBinary;
+		bool m_bWritable = false;
 		bool ShouldRemoveComments();
 		bool RemoveComments(unsigned char &c, bool bRemoveComments);
+		// Puts back the character that was just returned by ReadChar
+		virtual void UnreadChar(int c);
 	  public:
 		VFilePtrInternal();
 		virtual ~VFilePtrInternal();
@@ -85,13 +363,86 @@ export namespace pragma::filesystem {
 		virtual int Eof();
 		virtual int ReadChar();
 		virtual unsigned long long GetSize();
+		// Returns the contents of the file if they are available as contiguous memory, otherwise an empty span
+		virtual std::span<const uint8_t> GetMemory();
 		FVFile GetFlags() const;
 		template<class T>
 		T Read()
 		{
-			char c[sizeof(T)];
-			Read(c, sizeof(T));
-			return (*(T *)&(c[0]));
+			if constexpr(std::is_trivially_copyable_v<T>) {
+				std::array<std::byte, sizeof(T)> bytes {};
+				Read(bytes.data(), sizeof(T));
+				return std::bit_cast<T>(bytes);
+			}
+			else {
+				char c[sizeof(T)];
+				Read(c, sizeof(T));
+				return (*(T *)&(c[0]));
+			}
+		}
+		// Reads all values with a single read from the underlying file. Returns the number of values that were read completely.
+		template<class T>
+		    requires(std::is_trivially_copyable_v<T>)
+		size_t ReadArray(std::span<T> values)
+		{
+			if(values.empty())
+				return 0;
+			return Read(values.data(), values.size_bytes()) / sizeof(T);
+		}
+		// Same as above, but converts the values from the specified byte order to the native byte order
+		template<class T>
+		    requires(std::is_arithmetic_v<T> || std::is_enum_v<T>)
+		size_t ReadArray(std::span<T> values, std::endian endian)
+		{
+			auto n = ReadArray(values);
+			if constexpr(sizeof(T) > 1) {
+				if(endian != std::endian::native) {
+					for(size_t i = 0; i < n; ++i) {
+						auto *bytes = reinterpret_cast<std::byte *>(&values[i]);
+						std::reverse(bytes, bytes + sizeof(T));
+					}
+				}
+			}
+			return n;
+		}
+		template<class T>
+		    requires(std::is_trivially_copyable_v<T>)
+		std::vector<T> ReadVector(size_t count)
+		{
+			std::vector<T> values;
+			values.resize(count);
+			values.resize(ReadArray(std::span<T> {values}));
+			return values;
+		}
+		template<class T>
+		    requires(std::is_arithmetic_v<T> || std::is_enum_v<T>)
+		std::vector<T> ReadVector(size_t count, std::endian endian)
+		{
+			std::vector<T> values;
+			values.resize(count);
+			values.resize(ReadArray(std::span<T> {values}, endian));
+			return values;
+		}
+		// Parses a number from the text at the current position, see FileTokenizer::ReadNumber.
+		// Only the characters that belong to the number (and the leading whitespace) are consumed.
+		template<typename T>
+		    requires(std::is_integral_v<T> && !std::is_same_v<T, bool>)
+		std::optional<T> ReadInt()
+		{
+			return ReadNumber<T>();
+		}
+		template<typename T>
+		    requires(std::is_floating_point_v<T>)
+		std::optional<T> ReadFloat()
+		{
+			return ReadNumber<T>();
+		}
+		// Returns the number of values that were read successfully
+		template<typename T>
+		size_t ReadNumbers(std::span<T> values)
+		{
+			FileTokenizer tokenizer {*this};
+			return tokenizer.ReadNumbers(values);
 		}
 		std::string ReadString();
 		std::string ReadLine();
@@ -107,14 +458,47 @@ export namespace pragma::filesystem {
 		std::string ReadUntil(std::string s);
 		unsigned long long Find(const char *s, bool bIgnoreCase = false);
 		void IgnoreComments(std::string start = "//", std::string end = "\n");
+	  private:
+		// Skips whitespace and returns the text of the number at the current position.
+		// If the contents are in memory, the text is the rest of the file and nothing is consumed; outMemoryOffset is the offset of the text.
+		// Otherwise the characters that can be part of a number are read into the buffer. Returns an empty optional if they don't fit.
+		std::optional<std::string_view> ScanNumber(std::span<char> buffer, std::optional<unsigned long long> &outMemoryOffset);
+		// Moves the position to the end of the first parsedLength characters of the text returned by ScanNumber
+		void FinishNumber(const std::string_view &text, size_t parsedLength, const std::optional<unsigned long long> &memoryOffset);
+		template<typename T>
+		std::optional<T> ReadNumber()
+		{
+			// Comments may appear between numbers, which requires the tokenizer
+			if(!m_comments.empty() && ShouldRemoveComments()) {
+				FileTokenizer tokenizer {*this, FileTokenizer::INLINE_BUFFER_SIZE};
+				return tokenizer.ReadNumber<T>();
+			}
+			std::array<char, FileTokenizer::MAX_NUMBER_LENGTH> buffer;
+			std::optional<unsigned long long> memoryOffset;
+			auto text = ScanNumber(buffer, memoryOffset);
+			if(!text)
+				return {};
+			T value;
+			auto n = FileTokenizer::ParseNumber(*text, value);
+			FinishNumber(*text, n, memoryOffset);
+			if(n == 0)
+				return {};
+			return value;
+		}
 	};
 
 	class DLLFSYSTEM VFilePtrInternalVirtual : public VFilePtrInternal {
 	  private:
 		unsigned long long m_offset;
-		VFile *m_file;
+		std::shared_ptr<const VFileStorage> m_storage;
+		// Mapped once on construction so reads don't have to go through the storage
+		VFileStorage::Mapping m_mapping;
+		const uint8_t *m_data = nullptr;
+		unsigned long long m_size = 0;
 	  public:
 		VFilePtrInternalVirtual(VFile *file);
+		VFilePtrInternalVirtual(const std::shared_ptr<std::vector<uint8_t>> &data);
+		VFilePtrInternalVirtual(const std::shared_ptr<const VFileStorage> &storage);
 		virtual ~VFilePtrInternalVirtual() override;
 		size_t Read(void *ptr, size_t size) override;
 		unsigned long long Tell() override;
@@ -123,7 +507,44 @@ export namespace pragma::filesystem {
 		int Eof() override;
 		int ReadChar() override;
 		unsigned long long GetSize() override;
+		std::span<const uint8_t> GetMemory() override;
+		// Returns the contents if the file is vector-backed, otherwise nullptr. Use Map to access the contents of any storage.
 		std::shared_ptr<std::vector<uint8_t>> GetData() const;
+		const VFileStorage::Mapping &Map() const;
+		const std::shared_ptr<const VFileStorage> &GetStorage() const;
+	};
+
+	// Handle for a file in the writable virtual overlay (see add_writable_virtual_path).
+	// The contents are kept in memory and published as a virtual file on Flush and when the handle is destroyed.
+	class DLLFSYSTEM VFilePtrInternalMemory : public VFilePtrInternal {
+	  private:
+		std::string m_path;
+		std::shared_ptr<std::vector<uint8_t>> m_data;
+		unsigned long long m_offset = 0;
+		// Bytes reserved from the overlay memory budget for m_data
+		uint64_t m_reserved = 0;
+		// Set once m_data has been published. Further writes go to a copy, since readers may hold on to it.
+		bool m_published = false;
+		bool m_dirty = false;
+		bool m_append = false;
+		bool PrepareWrite(uint64_t newSize);
+		friend FileManager;
+	  public:
+		VFilePtrInternalMemory(std::string path, const std::shared_ptr<std::vector<uint8_t>> &data, uint64_t reserved, bool append);
+		virtual ~VFilePtrInternalMemory() override;
+		size_t Read(void *ptr, size_t size) override;
+		// Returns 1 if the data has been written, same as VFilePtrInternalReal::Write.
+		// Returns 0 if the write would exceed the overlay memory budget.
+		size_t Write(const void *ptr, size_t size);
+		unsigned long long Tell() override;
+		virtual void Seek(unsigned long long offset) override;
+		using VFilePtrInternal::Seek;
+		int Eof() override;
+		int ReadChar() override;
+		unsigned long long GetSize() override;
+		std::span<const uint8_t> GetMemory() override;
+		const std::string &GetPath() const;
+		void Flush();
 	};
 
 #undef CreateDirectory
@@ -168,6 +589,28 @@ export namespace pragma::filesystem {
 	DLLFSYSTEM bool create_path(const std::string_view &path);
 	DLLFSYSTEM bool create_directory(const std::string_view &dir);
 	DLLFSYSTEM std::pair<VDirectory *, VFile *> add_virtual_file(const std::string_view &path, const std::shared_ptr<std::vector<uint8_t>> &data);
+	DLLFSYSTEM std::pair<VDirectory *, VFile *> add_virtual_file(const std::string_view &path, const std::shared_ptr<const VFileStorage> &storage);
+	// See VFileGeneratorStorage
+	DLLFSYSTEM std::pair<VDirectory *, VFile *> add_generated_virtual_file(const std::string_view &path, const VFileGeneratorStorage::Generator &generator, std::optional<unsigned long long> sizeHint = {});
+	// Removes all virtual files. Pointers to virtual nodes are invalidated.
+	DLLFSYSTEM void clear_virtual_files();
+	DLLFSYSTEM bool remove_virtual_file(const std::string_view &path);
+	// Files opened for writing below this path are kept in memory as virtual files instead of being written to disk
+	DLLFSYSTEM void add_writable_virtual_path(const std::string_view &path);
+	DLLFSYSTEM void remove_writable_virtual_path(const std::string_view &path);
+	DLLFSYSTEM bool is_writable_virtual_path(const std::string_view &path);
+	// Maximum number of bytes held by writable virtual files. 0 means unlimited.
+	DLLFSYSTEM void set_writable_virtual_memory_budget(uint64_t budget);
+	DLLFSYSTEM uint64_t get_writable_virtual_memory_usage();
+	// Writes all writable virtual files below the path to the program write path and returns the number of files written.
+	// If release is true, the files are removed from memory afterwards.
+	DLLFSYSTEM uint32_t flush_writable_virtual_files(const std::string_view &path = {}, bool release = false);
+	// Returns the current state of the virtual files. The snapshot is unaffected by later changes.
+	DLLFSYSTEM std::shared_ptr<const VirtualSnapshot> get_virtual_snapshot();
+	// Runs f while holding the virtual file lock and publishes the changes afterwards by rebuilding the snapshot.
+	// Modifications to the root directory have to go through here to become visible. f must not call other virtual file functions.
+	DLLFSYSTEM void modify_virtual_files(const std::function<void(VDirectory &)> &f);
+	// The tree must only be modified through modify_virtual_files
 	DLLFSYSTEM VDirectory *get_root_directory();
 	DLLFSYSTEM Package *load_package(const std::string_view &package, SearchFlags searchMode = SearchFlags::Local);
 	DLLFSYSTEM void clear_packages(SearchFlags searchMode);
@@ -184,6 +627,12 @@ export namespace pragma::filesystem {
 	DLLFSYSTEM std::optional<std::filesystem::file_time_type> get_last_write_time(const std::string_view &path, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
 	DLLFSYSTEM std::uint64_t get_file_size(const std::string_view &name, SearchFlags fsearchmode = SearchFlags::All);
 	DLLFSYSTEM bool exists(const std::string_view &name, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
+	DLLFSYSTEM FileInfo get_file_info(const std::string_view &path, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
+	// Batched versions of exists and get_file_flags/get_file_size/get_last_write_time, the results are in the same order as the paths
+	DLLFSYSTEM std::vector<bool> exists_many(std::span<const std::string> paths, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
+	DLLFSYSTEM std::vector<FileInfo> stat_many(std::span<const std::string> paths, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
+	// Returns the first of baseName, baseName.extensions[0], baseName.extensions[1], ... that exists, see FileManager::FindAvailableFile
+	DLLFSYSTEM std::optional<std::string> resolve_available_file(const std::string &baseName, const std::vector<std::string_view> &extensions, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
 	DLLFSYSTEM bool is_file(const std::string_view &name, SearchFlags fsearchmode = SearchFlags::All);
 	DLLFSYSTEM bool is_dir(const std::string_view &name, SearchFlags fsearchmode = SearchFlags::All);
 	DLLFSYSTEM bool exists_system(const std::string_view &name);
@@ -195,6 +644,12 @@ export namespace pragma::filesystem {
 	DLLFSYSTEM void find_files(const std::string_view &cfind, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, bool bKeepPath, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
 	DLLFSYSTEM void find_files(const std::string_view &cfind, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
 	DLLFSYSTEM void find_system_files(const std::string_view &path, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, bool bKeepPath = false);
+	// Same as find_files, but entries are reported to the visitor as soon as they are found instead of being collected first.
+	// Returns false if the visitor stopped the enumeration. The visitor must not mount directories or load packages.
+	DLLFSYSTEM bool visit_files(const std::string_view &cfind, const DirectoryVisitor &visitor, bool includeSize = false, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
+	// Recursively visits all entries below the path. Every directory is listed once across all layers (see visit_files),
+	// and sub-directories are listed in parallel. Returns false if the visitor stopped the walk.
+	DLLFSYSTEM bool walk_directory(const std::string_view &path, const WalkVisitor &visitor, const WalkOptions &options = {});
 	DLLFSYSTEM bool copy_file(const std::string_view &cfile, const std::string_view &cfNewPath);
 	DLLFSYSTEM bool copy_system_file(const std::string_view &cfile, const std::string_view &cfNewPath);
 	DLLFSYSTEM bool move_file(const std::string_view &cfile, const std::string_view &cfNewPath);
@@ -225,17 +680,14 @@ export namespace pragma::filesystem {
 	template<typename TList>
 	std::optional<std::string> find_available_file(const std::string &fileName, const TList &exts)
 	{
-		if(exists(fileName))
-			return fileName;
+		// If the file already has one of the extensions, no other candidates are checked
 		auto ext = ufile::get_file_extension(fileName, exts);
 		if(ext)
-			return {};
-		for(auto &ext : exts) {
-			auto nFileName = fileName + '.' + ext;
-			if(exists(nFileName))
-				return nFileName;
-		}
-		return {};
+			return exists(fileName) ? fileName : std::optional<std::string> {};
+		std::vector<std::string_view> extensions;
+		for(auto &ext : exts)
+			extensions.push_back(ext);
+		return resolve_available_file(fileName, extensions);
 	}
 
 	class DLLFSYSTEM VFilePtrInternalReal : public VFilePtrInternal {
@@ -260,6 +712,8 @@ export namespace pragma::filesystem {
 		void Write(T t);
 		int WriteString(const std::string_view &sv, bool withBinaryZeroByte = true);
 		bool ReOpen(const char *mode);
+	  protected:
+		void UnreadChar(int c) override;
 	};
 #pragma warning(pop)
 }
@@ -274,12 +728,26 @@ export {
 namespace pragma::filesystem {
 	class DLLFSYSTEM FileManager {
 	  private:
+		// The arena must outlive the root directory
+		static VirtualArena m_virtualArena;
 		static VDirectory m_vroot;
 		static std::vector<MountDirectory> m_customMount;
 		static std::unordered_map<std::string, std::unique_ptr<PackageManager>> m_packages;
 		static std::unique_ptr<std::string> m_rootPath;
 		static std::function<VFilePtr(const std::string &, const char *mode)> m_customFileHandler;
-		static VData *GetVirtualData(std::string path);
+		// Modify the virtual file tree and apply the same change to the snapshot. The caller has to publish the snapshot.
+		static std::pair<VDirectory *, VFile *> AddVirtualFileUnlocked(std::string path, const std::shared_ptr<const VFileStorage> &storage, std::shared_ptr<const VirtualSnapshot> &snapshot);
+		// Same as AddVirtualFileUnlocked for multiple files. The paths are normalized in place.
+		static void AddVirtualFilesUnlocked(std::span<std::pair<std::string, std::shared_ptr<const VFileStorage>>> files, std::shared_ptr<const VirtualSnapshot> &snapshot);
+		// Only modifies the virtual file tree. The path is normalized in place.
+		static std::pair<VDirectory *, VFile *> AddVirtualFileToTree(std::string &path, const std::shared_ptr<const VFileStorage> &storage);
+		static bool RemoveVirtualFileUnlocked(std::string path, std::shared_ptr<const VirtualSnapshot> &snapshot);
+		// Rebuilds the snapshot from the virtual file tree
+		static void PublishVirtualSnapshot();
+		static VFilePtr OpenWritableVirtualFile(const std::string &path, const char *mode);
+		static void CommitWritableVirtualFile(const std::string &path, const std::shared_ptr<std::vector<uint8_t>> &data, uint64_t &reserved);
+		friend VirtualFileBatch;
+		friend VFilePtrInternalMemory;
 		static std::vector<std::string> FindAbsolutePaths(std::string path, SearchFlags includeFlags, SearchFlags excludeFlags, bool exitEarly);
 	  public:
 		static bool IsWriteMode(const char *mode);
@@ -298,6 +766,18 @@ namespace pragma::filesystem {
 		static bool CreateDirectory(const char *dir);
 		static void SetCustomFileHandler(const std::function<VFilePtr(const std::string &, const char *mode)> &fHandler);
 		static std::pair<VDirectory *, VFile *> AddVirtualFile(std::string path, const std::shared_ptr<std::vector<uint8_t>> &data);
+		static std::pair<VDirectory *, VFile *> AddVirtualFile(std::string path, const std::shared_ptr<const VFileStorage> &storage);
+		static void ClearVirtualFiles();
+		static bool RemoveVirtualFile(std::string path);
+		static void AddWritableVirtualPath(std::string path);
+		static void RemoveWritableVirtualPath(std::string path);
+		static bool IsWritableVirtualPath(std::string path);
+		static void SetWritableVirtualMemoryBudget(uint64_t budget);
+		static uint64_t GetWritableVirtualMemoryUsage();
+		static uint32_t FlushWritableVirtualFiles(std::string path = {}, bool release = false);
+		static std::shared_ptr<const VirtualSnapshot> GetVirtualSnapshot();
+		static void ModifyVirtualFiles(const std::function<void(VDirectory &)> &f);
+		// Changes made directly to the tree aren't visible to lookups, use ModifyVirtualFiles instead
 		static VDirectory *GetRootDirectory();
 		static Package *LoadPackage(std::string package, SearchFlags searchMode = SearchFlags::Local);
 		static void ClearPackages(SearchFlags searchMode);
@@ -328,7 +808,19 @@ namespace pragma::filesystem {
 		static std::optional<std::filesystem::file_time_type> GetLastWriteTime(const std::string_view &path, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
 		static std::uint64_t GetFileSize(std::string name, SearchFlags fsearchmode = SearchFlags::All);
 		static bool Exists(std::string name, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
+		// Like calling Exists for baseName and then for baseName + '.' + ext for every extension, but every layer is only searched once.
+		// Packages and the file index are probed for all candidates under a single lock, and every local directory is only opened once.
+		// Local candidates are probed by name, so on case-sensitive file systems only the directory part of the path is resolved case-insensitively,
+		// unless there are so many candidates that the directory is listed instead.
+		static std::optional<std::string> FindAvailableFile(const std::string &baseName, const std::vector<std::string_view> &extensions, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
 		static bool IsFile(std::string name, SearchFlags fsearchmode = SearchFlags::All);
+		// Type, size, last write time, permissions and source layer of the file from a single resolution.
+		// If includeDetails is false, only the flags and the layer are retrieved, see GetFileInfos.
+		static FileInfo GetFileInfo(std::string name, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None, bool includeDetails = true);
+		// Looks up all paths with a single lock per layer. Local files that aren't answered by the file index are stat'ed in parallel.
+		// If includeDetails is false, only the flags and the layer are retrieved. In that case local files that are answered by the file index
+		// aren't stat'ed, so whether they're in a mount is unknown and the layer is always reported as FileLayer::Root.
+		static std::vector<FileInfo> GetFileInfos(std::span<const std::string> paths, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None, bool includeDetails = true);
 		static bool IsDir(std::string name, SearchFlags fsearchmode = SearchFlags::All);
 		static bool ExistsSystem(std::string name);
 		static bool IsSystemFile(std::string name);
@@ -339,6 +831,7 @@ namespace pragma::filesystem {
 		static void FindFiles(const char *cfind, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, bool bKeepPath, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
 		static void FindFiles(const char *cfind, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
 		static void FindSystemFiles(const char *path, std::vector<std::string> *resfiles, std::vector<std::string> *resdirs, bool bKeepPath = false);
+		static bool VisitFiles(const char *cfind, const DirectoryVisitor &visitor, bool includeSize = false, SearchFlags includeFlags = SearchFlags::All, SearchFlags excludeFlags = SearchFlags::None);
 		static bool CopyFile(const char *cfile, const char *cfNewPath);
 		static bool CopySystemFile(const char *cfile, const char *cfNewPath);
 		static bool MoveFile(const char *cfile, const char *cfNewPath);
@@ -0,0 +1,73 @@
+// SPDX-FileCopyrightText: (c) 2026 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+export module pragma.filesystem:glob;
+
+export import std.compat;
+
+export namespace pragma::filesystem {
+#pragma warning(push)
+#pragma warning(disable : 4251)
+	// Wildcard pattern that is parsed once and can then be matched against many paths.
+	// Supported syntax:
+	// *       Any number of characters within a path segment
+	// ?       A single character
+	// [abc]   One of the characters, ranges ([a-z]) and negation ([!a] or [^a]) are supported
+	// {a,b}   One of the alternatives, may be nested
+	// **      Any number of path segments (only as a segment by itself, e.g. "a/**/b")
+	// Both '/' and '\\' are treated as separators. Characters without a special meaning are matched literally,
+	// which also applies to '[' and '{' if they are not closed.
+	// With Syntax::Wildcards only '*' and '?' are operators and everything else is matched literally. This is what
+	// FileManager::FindFiles/VisitFiles use, so existing names containing '[' or '{' can still be found.
+	class DLLFSYSTEM Glob {
+	  public:
+		enum class Syntax : uint8_t { Wildcards = 0, Extended };
+		static Glob Compile(const std::string_view &pattern, bool caseSensitive = false, Syntax syntax = Syntax::Extended);
+		Glob();
+		// Matches the entire path
+		bool Match(const std::string_view &path) const;
+		// Returns false if no path below the directory can match, which means the directory doesn't have to be listed
+		bool CanMatchBelow(const std::string_view &dirPath) const;
+		// Leading path segments that are shared by all alternatives and don't contain wildcards, including the trailing separator.
+		// Only paths in this directory or below can match.
+		const std::string &GetLiteralPrefix() const { return m_literalPrefix; }
+		// True if the pattern doesn't contain any wildcards
+		bool IsLiteral() const { return m_literal; }
+		// True if the pattern matches every name of a single segment, e.g. "*"
+		bool MatchesAll() const { return m_matchesAll; }
+		// True if the pattern contains "**" or a separator, i.e. it can match entries in sub-directories
+		bool HasMultipleSegments() const { return m_multipleSegments; }
+		const std::string &GetPattern() const { return m_pattern; }
+	  private:
+		struct Token {
+			enum class Type : uint8_t { Literal = 0, AnyChar, AnyString, CharClass };
+			Type type;
+			char literal = '\0';
+			uint16_t charClass = 0;
+		};
+		struct Segment {
+			// "**"
+			bool recursive = false;
+			std::vector<Token> tokens;
+		};
+		using Alternative = std::vector<Segment>;
+
+		bool MatchSegment(const Segment &segment, const std::string_view &name) const;
+		bool MatchSegments(const Alternative &alternative, size_t segmentIndex, const std::vector<std::string_view> &parts, size_t partIndex) const;
+		bool MatchPrefix(const Alternative &alternative, size_t segmentIndex, const std::vector<std::string_view> &parts, size_t partIndex) const;
+		char Normalize(char c) const;
+
+		std::string m_pattern;
+		std::vector<Alternative> m_alternatives;
+		// Character classes, indexed by Token::charClass
+		std::vector<std::bitset<256>> m_charClasses;
+		std::string m_literalPrefix;
+		bool m_caseSensitive = false;
+		bool m_literal = true;
+		bool m_matchesAll = false;
+		bool m_multipleSegments = false;
+	};
+#pragma warning(pop)
+}
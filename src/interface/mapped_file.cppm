@@ -0,0 +1,34 @@
+// SPDX-FileCopyrightText: (c) 2026 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+export module pragma.filesystem:mapped_file;
+
+export import std.compat;
+
+export namespace pragma::filesystem {
+#pragma warning(push)
+#pragma warning(disable : 4251)
+	// Read-only memory mapping of an entire file on disk
+	class DLLFSYSTEM MappedFile {
+	  public:
+		// Expects an absolute system path. Returns nullptr if the file could not be mapped.
+		static std::shared_ptr<MappedFile> Open(const std::string &path, std::string *optOutErr = nullptr);
+		~MappedFile();
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+		std::span<const uint8_t> GetData() const { return {m_data, m_size}; }
+		size_t GetSize() const { return m_size; }
+		const std::string &GetPath() const { return m_path; }
+	  private:
+		MappedFile() = default;
+		std::string m_path;
+		const uint8_t *m_data = nullptr;
+		size_t m_size = 0;
+		// Only used on Windows
+		void *m_fileHandle = nullptr;
+		void *m_mappingHandle = nullptr;
+	};
+#pragma warning(pop)
+}
@@ -5,6 +5,7 @@ export module pragma.filesystem:package;
 
 export import :enums;
 export import :file_handle;
+export import :file_system;
 
 export {
 	namespace pragma::filesystem {
@@ -17,6 +18,8 @@ export {
 		  private:
 			SearchFlags m_searchFlags = SearchFlags::None;
 		};
+		// The const lookup functions may be called from multiple threads at once.
+		// LoadPackage and ClearPackages are never called concurrently with anything else.
 		class DLLFSYSTEM PackageManager {
 		  public:
 			PackageManager() = default;
@@ -28,6 +31,23 @@ export {
 			virtual bool Exists(const std::string &name, SearchFlags includeFlags) const = 0;
 			virtual bool GetFileFlags(const std::string &name, SearchFlags includeFlags, FVFile &flags) const = 0;
 			virtual VFilePtr OpenFile(const std::string &path, bool bBinary, SearchFlags includeFlags, SearchFlags excludeFlags) const = 0;
+
+			struct EntryInfo {
+				// Relative path with '/' as separator
+				std::string path;
+				uint64_t size = 0;
+				FVFile flags = FVFile::None;
+				// Lookups with include flags that don't overlap with these skip the file
+				SearchFlags searchFlags = SearchFlags::All;
+			};
+			// Optional: Reports all files of the loaded packages, in the order in which the manager resolves them.
+			// If supported, the FileManager answers Exists, GetFileSize and GetFileFlags from a combined index and only calls OpenFile
+			// for the managers that contain the file. Directories are derived from the file paths and don't have to be reported.
+			// Returns false if enumeration isn't supported.
+			virtual bool EnumerateFiles(const std::function<void(const EntryInfo &)> &callback) const { return false; }
+			// Reports the same entries as FindFiles (without paths) to the visitor as they are found. Returns false if the visitor stopped the enumeration.
+			// The default implementation collects the results of FindFiles first, managers should override it if they can do better.
+			virtual bool VisitFiles(const std::string &target, const std::string &path, const DirectoryVisitor &visitor, bool includeSize, SearchFlags includeFlags) const;
 		  protected:
 			bool HasValue(std::vector<std::string> *values, size_t start, size_t end, std::string val, bool bKeepCase = false) const;
 		};
@@ -0,0 +1,122 @@
+// SPDX-FileCopyrightText: (c) 2026 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+export module pragma.filesystem:tokenizer;
+
+export import :file_handle;
+
+export namespace pragma::filesystem {
+#pragma warning(push)
+#pragma warning(disable : 4251)
+	// Splits the contents of a file into tokens without allocating a string per token.
+	// Files that expose their contents as contiguous memory (see VFilePtrInternal::GetMemory) are tokenized in-place,
+	// all other files are read through a buffer that is refilled on demand.
+	// Returned string views are only valid until the next call on the tokenizer.
+	// The underlying file is moved to the position of the tokenizer when the tokenizer is destroyed.
+	class DLLFSYSTEM FileTokenizer {
+	  public:
+		static constexpr size_t DEFAULT_BUFFER_SIZE = 16 * 1024;
+		// Buffers up to this size don't require a heap allocation
+		static constexpr size_t INLINE_BUFFER_SIZE = 256;
+		// Maximum number of characters that are considered when parsing a single number
+		static constexpr size_t MAX_NUMBER_LENGTH = 128;
+		FileTokenizer(const VFilePtr &f, size_t bufferSize = DEFAULT_BUFFER_SIZE);
+		FileTokenizer(VFilePtrInternal &f, size_t bufferSize = DEFAULT_BUFFER_SIZE);
+		~FileTokenizer();
+		FileTokenizer(const FileTokenizer &) = delete;
+		FileTokenizer &operator=(const FileTokenizer &) = delete;
+
+		// Returns the next whitespace-separated token, or an empty optional if the end of the file has been reached
+		std::optional<std::string_view> ReadToken();
+		// Reads until one of the delimiters is encountered. The delimiter itself is not consumed.
+		std::string_view ReadUntil(const std::string_view &delimiters);
+		// Reads until the end of the line. The new-line character is consumed, but not included in the result.
+		std::string_view ReadLine();
+		// Reads until a null-terminator. The terminator is consumed, but not included in the result.
+		std::string_view ReadString();
+		void SkipWhitespace();
+		std::optional<char> Peek();
+
+		// Parses the next number with std::from_chars (locale-independent). Leading whitespace and comments are skipped.
+		template<typename T>
+		    requires(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>)
+		std::optional<T> ReadNumber()
+		{
+			auto sv = PrepareNumber();
+			T value;
+			auto n = ParseNumber(sv, value);
+			// The window holds at least MAX_NUMBER_LENGTH characters unless the file ends, so a number that reaches its end is too long
+			if(n == 0 || (n == sv.size() && !m_fileEof))
+				return {};
+			Advance(n);
+			return value;
+		}
+		// Parses a number from the start of the text with std::from_chars. A leading '+' is accepted, but not if another sign follows it.
+		// Returns the number of characters that belong to the number, or 0 if the text doesn't start with one.
+		template<typename T>
+		    requires(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>)
+		static size_t ParseNumber(const std::string_view &text, T &outValue)
+		{
+			size_t prefix = (text.size() > 1 && text[0] == '+' && text[1] != '+' && text[1] != '-') ? 1 : 0;
+			auto res = std::from_chars(text.data() + prefix, text.data() + text.size(), outValue);
+			if(res.ec != std::errc {})
+				return 0;
+			return res.ptr - text.data();
+		}
+		// Returns the number of values that were read successfully
+		template<typename T>
+		    requires(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>)
+		size_t ReadNumbers(std::span<T> values)
+		{
+			for(size_t i = 0; i < values.size(); ++i) {
+				auto value = ReadNumber<T>();
+				if(!value)
+					return i;
+				values[i] = *value;
+			}
+			return values.size();
+		}
+		bool Eof();
+		unsigned long long Tell() const;
+		bool IsZeroCopy() const { return m_zeroCopy; }
+		void IgnoreComments(std::string start = "//", std::string end = "\n");
+	  private:
+		struct Comment {
+			std::string start;
+			std::string end;
+		};
+		void Init(size_t bufferSize);
+		std::string_view PrepareNumber();
+		void Advance(size_t n) { m_pos += n; }
+		bool Fill();
+		bool Ensure(size_t n);
+		bool IsCommentStart();
+		bool SkipComment();
+		std::string_view Scan(const std::array<bool, 256> &stopTable);
+		void UpdateCommentTable();
+
+		VFilePtr m_fileOwner = nullptr;
+		VFilePtrInternal &m_file;
+
+		// Current window into the file contents. Everything before m_anchor may be discarded on the next refill.
+		const char *m_data = nullptr;
+		size_t m_pos = 0;
+		size_t m_end = 0;
+		size_t m_anchor = 0;
+		unsigned long long m_windowOffset = 0;
+		bool m_zeroCopy = false;
+		bool m_fileEof = false;
+
+		char *m_buffer = nullptr;
+		size_t m_bufferSize = 0;
+		std::vector<char> m_heapBuffer;
+		std::array<char, INLINE_BUFFER_SIZE> m_inlineBuffer;
+		// Only used if a token is interrupted by a comment
+		std::string m_scratch;
+		std::vector<Comment> m_comments;
+		std::array<bool, 256> m_commentStarts {};
+	};
+#pragma warning(pop)
+}
@@ -4,10 +4,42 @@
 export module pragma.filesystem:util;
 
 export import std.compat;
+import :file_system;
 
 export namespace pragma::filesystem {
 	namespace impl {
 		DLLFSYSTEM bool has_value(std::vector<std::string> *values, size_t start, size_t end, std::string val, bool bKeepCase = false);
 		void to_case_sensitive_path(std::string &inOutCaseInsensitivePath);
+
+		// Tracks the names that have been reported by the sources of a search, to skip duplicates.
+		// Names are compared either case-sensitively or not, the lookup set for a comparison mode is only built once it is used.
+		class DLLFSYSTEM DuplicateFilter {
+		  public:
+			// Returns false if the name has already been added
+			bool Add(const std::string_view &name, bool bKeepCase = false);
+		  private:
+			// Elements of a deque don't move, so the sets can refer to them
+			std::deque<std::string> m_names;
+			std::unordered_set<std::string_view> m_entries;
+			std::unordered_set<std::string_view, detail::CaseInsensitiveHash, detail::CaseInsensitiveEqual> m_caseInsensitiveEntries;
+			// Number of names that have been inserted into the respective set
+			size_t m_entryCount = 0;
+			size_t m_caseInsensitiveEntryCount = 0;
+		};
+
+		// Removes duplicates from search results that are collected from multiple sources (e.g. roots, mounts or packages).
+		class DLLFSYSTEM FindResultFilter {
+		  public:
+			// Entries before start are not affected by the filter
+			FindResultFilter(std::vector<std::string> *results, size_t start = 0);
+			// Removes the entries that were added since the last call and have already been added before, by this or a previous source
+			void Commit(bool bKeepCase = false);
+			// Entries before start are kept as they are, but later entries that duplicate them are removed by Commit
+			void ExcludeExisting(bool bKeepCase = false);
+		  private:
+			std::vector<std::string> *m_results = nullptr;
+			size_t m_committed = 0;
+			DuplicateFilter m_filter;
+		};
 	};
 };
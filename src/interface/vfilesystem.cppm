@@ -4,14 +4,18 @@
 module;
 
 export module pragma.filesystem;
+export import :archive;
 export import :directory_watcher;
 export import :enums;
 export import :file_handle;
 export import :file_index_cache;
 export import :file_interface;
 export import :file_system;
+export import :glob;
+export import :mapped_file;
 export import :package;
 export import :stream;
+export import :tokenizer;
 
 export namespace pragma::fs {
     using namespace filesystem;
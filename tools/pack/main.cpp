@@ -0,0 +1,276 @@
+// SPDX-FileCopyrightText: (c) 2026 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+// Builds an archive that can be loaded with pragma::filesystem::ArchivePackageManager from a directory tree.
+// Usage: vfilesystem_pack <input directory> <output file> [options]
+
+import pragma.filesystem;
+import std.compat;
+
+namespace {
+	struct Options {
+		std::string inputPath;
+		std::string outputPath;
+		std::string manifestPath;
+		pragma::fs::ArchiveCompression compression = pragma::fs::ArchiveCompression::Lzma;
+		uint32_t level = 6;
+		uint32_t chunkSize = 0;
+		uint32_t alignment = pragma::fs::archive::DEFAULT_ALIGNMENT;
+		uint32_t threads = 0;
+	};
+	struct InputFile {
+		// Relative to the input directory, with '/' as separator
+		std::string path;
+		std::string absolutePath;
+		uint64_t size = 0;
+		uint32_t crc = 0;
+		bool valid = false;
+		size_t blob = pragma::fs::ArchiveWriter::INVALID_BLOB;
+	};
+}
+
+static constexpr size_t READ_BUFFER_SIZE = 1024 * 1024;
+
+static void print_usage()
+{
+	std::cout << "Usage: vfilesystem_pack <input directory> <output file> [options]\n"
+	          << "Options:\n"
+	          << "  --manifest <file>      Text file with one relative path per line. Listed files are stored first and in that order.\n"
+	          << "  --compression <type>   none, lzma or bz2 (default: lzma)\n"
+	          << "  --level <n>            LZMA preset (0-9) or bzip2 block size (1-9) (default: 6)\n"
+	          << "  --chunk-size <bytes>   Splits larger files into independently compressed chunks (default: 0, disabled)\n"
+	          << "  --alignment <bytes>    Alignment of uncompressed files (default: " << pragma::fs::archive::DEFAULT_ALIGNMENT << ")\n"
+	          << "  --threads <n>          Number of worker threads, 0 uses all hardware threads (default: 0)\n";
+}
+
+static std::optional<uint32_t> parse_uint(const std::string_view &str)
+{
+	uint32_t value;
+	auto res = std::from_chars(str.data(), str.data() + str.size(), value);
+	if(res.ec != std::errc {} || res.ptr != str.data() + str.size())
+		return {};
+	return value;
+}
+
+static std::optional<Options> parse_options(int argc, char *argv[])
+{
+	if(argc < 3)
+		return {};
+	Options options {};
+	options.inputPath = argv[1];
+	options.outputPath = argv[2];
+	for(int i = 3; i < argc; ++i) {
+		std::string_view arg = argv[i];
+		if(i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << "\n";
+			return {};
+		}
+		std::string_view value = argv[++i];
+		std::optional<uint32_t> number {};
+		if(arg == "--manifest")
+			options.manifestPath = value;
+		else if(arg == "--compression") {
+			if(value == "none")
+				options.compression = pragma::fs::ArchiveCompression::None;
+			else if(value == "lzma")
+				options.compression = pragma::fs::ArchiveCompression::Lzma;
+			else if(value == "bz2")
+				options.compression = pragma::fs::ArchiveCompression::Bz2;
+			else {
+				std::cerr << "Unknown compression type '" << value << "'\n";
+				return {};
+			}
+		}
+		else if((number = parse_uint(value))) {
+			if(arg == "--level")
+				options.level = *number;
+			else if(arg == "--chunk-size")
+				options.chunkSize = *number;
+			else if(arg == "--alignment")
+				options.alignment = *number;
+			else if(arg == "--threads")
+				options.threads = *number;
+			else {
+				std::cerr << "Unknown option " << arg << "\n";
+				return {};
+			}
+		}
+		else {
+			std::cerr << "Invalid value '" << value << "' for " << arg << "\n";
+			return {};
+		}
+	}
+	return options;
+}
+
+static void collect_files(const std::string &rootPath, const std::string &relPath, std::vector<InputFile> &outFiles)
+{
+	std::vector<std::string> files;
+	std::vector<std::string> dirs;
+	auto absPath = relPath.empty() ? rootPath : (rootPath + '/' + relPath);
+	pragma::fs::find_system_files(absPath + "/*", &files, &dirs);
+	std::sort(files.begin(), files.end());
+	std::sort(dirs.begin(), dirs.end());
+	for(auto &file : files) {
+		InputFile input {};
+		input.path = relPath.empty() ? file : (relPath + '/' + file);
+		input.absolutePath = absPath + '/' + file;
+		outFiles.push_back(std::move(input));
+	}
+	for(auto &dir : dirs)
+		collect_files(rootPath, relPath.empty() ? dir : (relPath + '/' + dir), outFiles);
+}
+
+static std::shared_ptr<const std::vector<uint8_t>> read_contents(const std::string &path)
+{
+	auto f = pragma::fs::FileManager::OpenSystemFile(path.c_str(), "rb");
+	if(!f)
+		return nullptr;
+	auto data = std::make_shared<std::vector<uint8_t>>(f->GetSize());
+	if(!data->empty() && f->Read(data->data(), data->size()) != data->size())
+		return nullptr;
+	return data;
+}
+
+// Reads the file in blocks, so the hashing pass doesn't need to keep whole files in memory
+static bool hash_file(InputFile &file)
+{
+	auto f = pragma::fs::FileManager::OpenSystemFile(file.absolutePath.c_str(), "rb");
+	if(!f)
+		return false;
+	file.size = f->GetSize();
+	std::vector<uint8_t> buffer(std::min<uint64_t>(file.size, READ_BUFFER_SIZE));
+	uint32_t crc = 0;
+	for(uint64_t remaining = file.size; remaining > 0;) {
+		auto n = f->Read(buffer.data(), std::min<uint64_t>(remaining, buffer.size()));
+		if(n == 0)
+			return false;
+		crc = pragma::fs::archive::crc32({buffer.data(), n}, crc);
+		remaining -= n;
+	}
+	file.crc = crc;
+	return true;
+}
+
+static bool contents_equal(const std::string &pathA, const std::string &pathB)
+{
+	auto fa = pragma::fs::FileManager::OpenSystemFile(pathA.c_str(), "rb");
+	auto fb = pragma::fs::FileManager::OpenSystemFile(pathB.c_str(), "rb");
+	if(!fa || !fb || fa->GetSize() != fb->GetSize())
+		return false;
+	std::vector<uint8_t> bufferA(READ_BUFFER_SIZE);
+	std::vector<uint8_t> bufferB(READ_BUFFER_SIZE);
+	for(;;) {
+		auto na = fa->Read(bufferA.data(), bufferA.size());
+		auto nb = fb->Read(bufferB.data(), bufferB.size());
+		if(na != nb || std::memcmp(bufferA.data(), bufferB.data(), na) != 0)
+			return false;
+		if(na == 0)
+			return true;
+	}
+}
+
+// Moves the files listed in the manifest to the front, in the order of the manifest
+static bool apply_manifest(const std::string &manifestPath, std::vector<InputFile> &files)
+{
+	auto f = pragma::fs::FileManager::OpenSystemFile(manifestPath.c_str(), "r");
+	if(!f)
+		return false;
+	std::unordered_map<std::string, size_t, pragma::fs::detail::CaseInsensitiveHash, pragma::fs::detail::CaseInsensitiveEqual> ranks;
+	while(!f->Eof()) {
+		auto line = f->ReadLine();
+		auto start = line.find_first_not_of(" \t\r");
+		line = (start != std::string::npos) ? line.substr(start, line.find_last_not_of(" \t\r") - start + 1) : std::string {};
+		std::replace(line.begin(), line.end(), '\\', '/');
+		if(line.empty() || line.front() == '#')
+			continue;
+		ranks.try_emplace(line, ranks.size());
+	}
+	auto getRank = [&ranks](const InputFile &file) {
+		auto it = ranks.find(file.path);
+		return (it != ranks.end()) ? it->second : std::numeric_limits<size_t>::max();
+	};
+	std::stable_sort(files.begin(), files.end(), [&getRank](const InputFile &a, const InputFile &b) { return getRank(a) < getRank(b); });
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	auto options = parse_options(argc, argv);
+	if(!options) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
+	auto inputPath = options->inputPath;
+	while(!inputPath.empty() && (inputPath.back() == '/' || inputPath.back() == '\\'))
+		inputPath.pop_back();
+	if(!pragma::fs::is_system_dir(inputPath)) {
+		std::cerr << "Input directory '" << options->inputPath << "' does not exist\n";
+		return EXIT_FAILURE;
+	}
+
+	std::vector<InputFile> files;
+	collect_files(inputPath, "", files);
+	if(!options->manifestPath.empty() && !apply_manifest(options->manifestPath, files)) {
+		std::cerr << "Failed to open manifest '" << options->manifestPath << "'\n";
+		return EXIT_FAILURE;
+	}
+
+	auto threadCount = (options->threads == 0) ? std::max(std::thread::hardware_concurrency(), 1u) : options->threads;
+	{
+		BS::light_thread_pool pool {threadCount};
+		for(auto &file : files)
+			pool.detach_task([&file]() { file.valid = hash_file(file); });
+		pool.wait();
+	}
+
+	// Files with identical contents share a blob
+	pragma::fs::ArchiveWriter writer {};
+	writer.SetAlignment(options->alignment);
+	writer.SetCompressionLevel(options->level);
+	writer.SetThreadCount(threadCount);
+	std::unordered_map<uint64_t, std::vector<const InputFile *>> blobsByHash;
+	uint64_t totalSize = 0;
+	uint64_t duplicateSize = 0;
+	size_t duplicateCount = 0;
+	for(auto &file : files) {
+		if(!file.valid) {
+			std::cerr << "Failed to read '" << file.absolutePath << "'\n";
+			return EXIT_FAILURE;
+		}
+		totalSize += file.size;
+		auto &candidates = blobsByHash[(file.size << 32) ^ file.crc];
+		for(auto *candidate : candidates) {
+			if(candidate->size == file.size && candidate->crc == file.crc && contents_equal(candidate->absolutePath, file.absolutePath)) {
+				file.blob = candidate->blob;
+				break;
+			}
+		}
+		if(file.blob != pragma::fs::ArchiveWriter::INVALID_BLOB) {
+			duplicateSize += file.size;
+			++duplicateCount;
+		}
+		else {
+			file.blob = writer.AddBlob([path = file.absolutePath]() { return read_contents(path); }, options->compression, options->chunkSize);
+			candidates.push_back(&file);
+		}
+		if(!writer.AddEntry(file.path, file.blob)) {
+			// Archive paths are case-insensitive, so inputs that only differ in case collide
+			auto it = std::find_if(files.begin(), files.end(), [&file](const InputFile &other) { return &other != &file && pragma::fs::compare_path(other.path, file.path); });
+			std::cerr << "Failed to add '" << file.absolutePath << "'";
+			if(it != files.end())
+				std::cerr << ": its archive path collides with '" << it->absolutePath << "'";
+			std::cerr << "\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::string err;
+	if(!writer.Write(options->outputPath, &err)) {
+		std::cerr << "Failed to write '" << options->outputPath << "': " << err << "\n";
+		return EXIT_FAILURE;
+	}
+	std::cout << "Wrote " << writer.GetEntryCount() << " files (" << totalSize << " bytes) to '" << options->outputPath << "'\n";
+	std::cout << duplicateCount << " duplicate files (" << duplicateSize << " bytes) were deduplicated\n";
+	return EXIT_SUCCESS;
+}